@@ -0,0 +1,614 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "archive.h"
+#include "util.h"
+
+#define PAYLOAD_SIZE (GRIDCTL_ARCHIVE_BLOCK_SIZE - sizeof(struct gridctl_archive_block_header))
+
+/* A varint is at most 10 bytes, and a sample is four of them */
+#define VARINT_MAX_SIZE 10
+#define SAMPLE_MAX_SIZE (4 * VARINT_MAX_SIZE)
+
+struct archive_block {
+    struct gridctl_archive_block_header header; /* host byte order until written */
+    guint8 payload[PAYLOAD_SIZE];
+
+    /* Encoder state, only meaningful while header.n_samples > 0 */
+    struct gridctl_archive_sample last;
+    gint64 last_delta;
+};
+
+struct _GridctlArchiveWriter {
+    gchar *path;
+    FILE *file;
+    guint64 offset;
+
+    struct archive_block blocks[NZXT_GRID_V3_CHANNEL_COUNT];
+    guint8 scratch[GRIDCTL_ARCHIVE_BLOCK_SIZE];
+
+    guint64 n_blocks;
+    guint64 n_samples;
+};
+
+struct archive_index {
+    GArray *blocks; /* guint32 block numbers, in file order */
+    gboolean ordered; /* blocks don't overlap in time, so they can be binary searched */
+};
+
+struct _GridctlArchiveReader {
+    GMappedFile *file;
+    const guint8 *data;
+    gsize size;
+    guint64 n_blocks;
+    guint64 n_samples;
+
+    struct archive_index index[NZXT_GRID_V3_CHANNEL_COUNT];
+};
+
+static inline guint64
+zigzag_encode(gint64 value)
+{
+    return ((guint64)value << 1) ^ (guint64)(value >> 63);
+}
+
+static inline gint64
+zigzag_decode(guint64 value)
+{
+    return (gint64)(value >> 1) ^ -(gint64)(value & 1);
+}
+
+static inline gsize
+put_varint(guint8 *p, guint64 value)
+{
+    gsize n = 0;
+
+    while (value >= 0x80) {
+        p[n++] = (guint8)value | 0x80;
+        value >>= 7;
+    }
+
+    p[n++] = (guint8)value;
+    return n;
+}
+
+static inline gboolean
+get_varint(const guint8 **p, const guint8 *end, guint64 *value)
+{
+    guint64 result = 0;
+
+    for (guint shift = 0; shift < 7 * VARINT_MAX_SIZE && *p < end; shift += 7) {
+        guint8 byte = *(*p)++;
+
+        result |= (guint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+check_file_header(const struct gridctl_archive_file_header *header,
+                  const gchar *path,
+                  GError **error)
+{
+    if (memcmp(header->magic, GRIDCTL_ARCHIVE_MAGIC, sizeof(header->magic)) != 0
+        || GUINT32_FROM_LE(header->version) != GRIDCTL_ARCHIVE_VERSION
+        || GUINT32_FROM_LE(header->block_size) != GRIDCTL_ARCHIVE_BLOCK_SIZE)
+    {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_INVAL,
+                    "%s is not a version %u gridctl archive",
+                    path,
+                    GRIDCTL_ARCHIVE_VERSION);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+GridctlArchiveWriter *
+gridctl_archive_writer_new(const gchar *path, GError **error)
+{
+    FILE *file = g_fopen(path, "r+b");
+    if (!file && errno == ENOENT) {
+        file = g_fopen(path, "w+b");
+    }
+    if (!file) {
+        gridctl_set_error_from_errno(error, "fopen", path);
+        return NULL;
+    }
+
+    struct gridctl_archive_file_header header;
+    gsize header_size = fread(&header, 1, sizeof(header), file);
+
+    if (header_size == 0 && !ferror(file)) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GRIDCTL_ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = GUINT32_TO_LE(GRIDCTL_ARCHIVE_VERSION);
+        header.block_size = GUINT32_TO_LE(GRIDCTL_ARCHIVE_BLOCK_SIZE);
+
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+            gridctl_set_error_from_errno(error, "fwrite", path);
+            fclose(file);
+            return NULL;
+        }
+    } else if (header_size != sizeof(header)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: truncated archive header", path);
+        fclose(file);
+        return NULL;
+    } else if (!check_file_header(&header, path, error)) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0) {
+        gridctl_set_error_from_errno(error, "fseek", path);
+        fclose(file);
+        return NULL;
+    }
+
+    /*
+     * A crash can leave a torn block at the end. Readers ignore it, and the next block written
+     * here overwrites it.
+     */
+    guint64 size = (guint64)ftell(file);
+    guint64 offset = size - (size - sizeof(header)) % GRIDCTL_ARCHIVE_BLOCK_SIZE;
+
+    if (offset != size) {
+        g_debug("%s: dropping %" G_GUINT64_FORMAT " bytes of a torn block", path, size - offset);
+    }
+
+    GridctlArchiveWriter *writer = g_new0(GridctlArchiveWriter, 1);
+    writer->path = g_strdup(path);
+    writer->file = file;
+    writer->offset = offset;
+    return writer;
+}
+
+static gboolean
+write_block(GridctlArchiveWriter *writer, struct archive_block *block, GError **error)
+{
+    struct gridctl_archive_block_header *header = (void *)writer->scratch;
+
+    *header = (struct gridctl_archive_block_header){
+        .magic = GUINT32_TO_LE(GRIDCTL_ARCHIVE_BLOCK_MAGIC),
+        .channel = block->header.channel,
+        .fan_type = block->header.fan_type,
+        .n_samples = GUINT16_TO_LE(block->header.n_samples),
+        .payload_size = GUINT32_TO_LE(block->header.payload_size),
+        .time_min = GINT64_TO_LE(block->header.time_min),
+        .time_max = GINT64_TO_LE(block->header.time_max),
+        .rpm_min = GUINT16_TO_LE(block->header.rpm_min),
+        .rpm_max = GUINT16_TO_LE(block->header.rpm_max),
+        .voltage_mv_min = GUINT32_TO_LE(block->header.voltage_mv_min),
+        .voltage_mv_max = GUINT32_TO_LE(block->header.voltage_mv_max),
+        .current_ma_min = GUINT32_TO_LE(block->header.current_ma_min),
+        .current_ma_max = GUINT32_TO_LE(block->header.current_ma_max),
+    };
+
+    guint8 *payload = writer->scratch + sizeof(*header);
+    memcpy(payload, block->payload, block->header.payload_size);
+    memset(payload + block->header.payload_size, 0, PAYLOAD_SIZE - block->header.payload_size);
+
+    /* The block is dropped on error: retrying forever would only stall the samples after it */
+    block->header.n_samples = 0;
+    block->header.payload_size = 0;
+
+    if (fseek(writer->file, (long)writer->offset, SEEK_SET) != 0) {
+        gridctl_set_error_from_errno(error, "fseek", writer->path);
+        return FALSE;
+    }
+
+    if (fwrite(writer->scratch, sizeof(writer->scratch), 1, writer->file) != 1
+        || fflush(writer->file) != 0)
+    {
+        gridctl_set_error_from_errno(error, "fwrite", writer->path);
+        return FALSE;
+    }
+
+    writer->offset += sizeof(writer->scratch);
+    writer->n_blocks++;
+    return TRUE;
+}
+
+static void
+encode_sample(struct archive_block *block, const struct gridctl_archive_sample *sample)
+{
+    struct gridctl_archive_block_header *header = &block->header;
+    guint8 *p = block->payload + header->payload_size;
+
+    if (header->n_samples == 0) {
+        header->channel = sample->channel;
+        header->fan_type = sample->fan_type;
+        header->time_min = header->time_max = sample->time;
+        header->rpm_min = header->rpm_max = sample->rpm;
+        header->voltage_mv_min = header->voltage_mv_max = sample->voltage_mv;
+        header->current_ma_min = header->current_ma_max = sample->current_ma;
+
+        p += put_varint(p, zigzag_encode(sample->time));
+        p += put_varint(p, sample->rpm);
+        p += put_varint(p, sample->voltage_mv);
+        p += put_varint(p, sample->current_ma);
+
+        block->last_delta = 0;
+    } else {
+        /* Reports arrive at a steady rate, so the delta-of-delta is almost always 0 */
+        gint64 delta = sample->time - block->last.time;
+
+        p += put_varint(p, zigzag_encode(delta - block->last_delta));
+        p += put_varint(p, zigzag_encode((gint64)sample->rpm - block->last.rpm));
+        p += put_varint(p, zigzag_encode((gint64)sample->voltage_mv - block->last.voltage_mv));
+        p += put_varint(p, zigzag_encode((gint64)sample->current_ma - block->last.current_ma));
+
+        header->time_min = MIN(header->time_min, sample->time);
+        header->time_max = MAX(header->time_max, sample->time);
+        header->rpm_min = MIN(header->rpm_min, sample->rpm);
+        header->rpm_max = MAX(header->rpm_max, sample->rpm);
+        header->voltage_mv_min = MIN(header->voltage_mv_min, sample->voltage_mv);
+        header->voltage_mv_max = MAX(header->voltage_mv_max, sample->voltage_mv);
+        header->current_ma_min = MIN(header->current_ma_min, sample->current_ma);
+        header->current_ma_max = MAX(header->current_ma_max, sample->current_ma);
+
+        block->last_delta = delta;
+    }
+
+    header->payload_size = (guint32)(p - block->payload);
+    header->n_samples++;
+    block->last = *sample;
+}
+
+gboolean
+gridctl_archive_writer_append(GridctlArchiveWriter *writer,
+                              const struct gridctl_archive_sample *sample,
+                              GError **error)
+{
+    g_return_val_if_fail(sample->channel < NZXT_GRID_V3_CHANNEL_COUNT, FALSE);
+
+    struct archive_block *block = &writer->blocks[sample->channel];
+    gboolean ok = TRUE;
+
+    /* Fan type is per block, so a change (e.g. a fan plugged in) starts a new one */
+    if (block->header.n_samples > 0
+        && (block->header.payload_size + SAMPLE_MAX_SIZE > PAYLOAD_SIZE
+            || block->header.n_samples == G_MAXUINT16
+            || block->header.fan_type != sample->fan_type))
+    {
+        ok = write_block(writer, block, error);
+    }
+
+    encode_sample(block, sample);
+    writer->n_samples++;
+    return ok;
+}
+
+gboolean
+gridctl_archive_writer_append_report(GridctlArchiveWriter *writer,
+                                     const struct nzxt_grid_status_report *report,
+                                     gint64 real_time,
+                                     GError **error)
+{
+    struct gridctl_archive_sample sample = {
+        .time = real_time / 1000,
+        .channel = nzxt_grid_status_report_get_channel(report),
+        .fan_type = nzxt_grid_status_report_get_fan_type(report),
+        .rpm = nzxt_grid_status_report_get_rpm(report),
+        .voltage_mv = nzxt_grid_status_report_get_voltage_mv(report),
+        .current_ma = nzxt_grid_status_report_get_current_ma(report),
+    };
+
+    if (sample.channel >= NZXT_GRID_V3_CHANNEL_COUNT) {
+        return TRUE;
+    }
+
+    return gridctl_archive_writer_append(writer, &sample, error);
+}
+
+/* Writes out partially filled blocks, so samples survive a crash at the cost of some padding */
+gboolean
+gridctl_archive_writer_flush(GridctlArchiveWriter *writer, GError **error)
+{
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        struct archive_block *block = &writer->blocks[channel];
+
+        if (block->header.n_samples > 0 && !write_block(writer, block, error)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void
+gridctl_archive_writer_get_stats(GridctlArchiveWriter *writer, struct gridctl_archive_stats *stats)
+{
+    *stats = (struct gridctl_archive_stats){
+        .n_blocks = writer->n_blocks,
+        .n_samples = writer->n_samples,
+        .file_size = writer->offset,
+    };
+}
+
+/* Samples in open blocks are lost unless gridctl_archive_writer_flush() was called first */
+void
+gridctl_archive_writer_free(GridctlArchiveWriter *writer)
+{
+    fclose(writer->file);
+    g_free(writer->path);
+    g_free(writer);
+}
+
+static inline const struct gridctl_archive_block_header *
+reader_get_block(GridctlArchiveReader *reader, guint64 block)
+{
+    const struct gridctl_archive_block_header *header
+        = (const void *)(reader->data + sizeof(struct gridctl_archive_file_header)
+                         + block * GRIDCTL_ARCHIVE_BLOCK_SIZE);
+
+    if (GUINT32_FROM_LE(header->magic) != GRIDCTL_ARCHIVE_BLOCK_MAGIC
+        || header->channel >= NZXT_GRID_V3_CHANNEL_COUNT
+        || GUINT32_FROM_LE(header->payload_size) > PAYLOAD_SIZE)
+    {
+        return NULL;
+    }
+
+    return header;
+}
+
+GridctlArchiveReader *
+gridctl_archive_reader_new(const gchar *path, GError **error)
+{
+    GMappedFile *file = g_mapped_file_new(path, FALSE, error);
+    if (!file) {
+        return NULL;
+    }
+
+    const guint8 *data = (const guint8 *)g_mapped_file_get_contents(file);
+    gsize size = g_mapped_file_get_length(file);
+
+    if (size < sizeof(struct gridctl_archive_file_header)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: truncated archive header", path);
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    if (!check_file_header((const void *)data, path, error)) {
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    GridctlArchiveReader *reader = g_new0(GridctlArchiveReader, 1);
+    reader->file = file;
+    reader->data = data;
+    reader->size = size;
+    /* Block numbers are 32-bit in the index, i.e. up to 16 TiB */
+    guint64 n_blocks
+        = (size - sizeof(struct gridctl_archive_file_header)) / GRIDCTL_ARCHIVE_BLOCK_SIZE;
+    reader->n_blocks = MIN(n_blocks, G_MAXUINT32);
+
+    gint64 last_time[NZXT_GRID_V3_CHANNEL_COUNT];
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        reader->index[channel].blocks = g_array_new(FALSE, FALSE, sizeof(guint32));
+        reader->index[channel].ordered = TRUE;
+        last_time[channel] = G_MININT64;
+    }
+
+    /*
+     * Blocks of a channel are normally written in time order. The wall clock can step back, e.g.
+     * on an NTP correction, and then that channel falls back to a linear scan.
+     */
+    for (guint32 i = 0; i < reader->n_blocks; i++) {
+        const struct gridctl_archive_block_header *header = reader_get_block(reader, i);
+        if (!header) {
+            continue;
+        }
+
+        struct archive_index *index = &reader->index[header->channel];
+        gint64 time_min = GINT64_FROM_LE(header->time_min);
+
+        if (time_min < last_time[header->channel]) {
+            index->ordered = FALSE;
+        }
+
+        last_time[header->channel] = MAX(last_time[header->channel],
+                                         (gint64)GINT64_FROM_LE(header->time_max));
+        g_array_append_val(index->blocks, i);
+        reader->n_samples += GUINT16_FROM_LE(header->n_samples);
+    }
+
+    return reader;
+}
+
+static gboolean
+header_matches(const struct gridctl_archive_block_header *header,
+               const struct gridctl_archive_query *query)
+{
+    return (query->channel == GRIDCTL_ARCHIVE_ANY_CHANNEL || query->channel == header->channel)
+           && (gint64)GINT64_FROM_LE(header->time_max) >= query->time_from
+           && (gint64)GINT64_FROM_LE(header->time_min) <= query->time_to
+           && GUINT16_FROM_LE(header->rpm_max) >= query->rpm_min
+           && GUINT16_FROM_LE(header->rpm_min) <= query->rpm_max;
+}
+
+/* Returns FALSE if func asked to stop; corrupt payloads are cut short with a warning */
+static gboolean
+decode_block(const struct gridctl_archive_block_header *header,
+             const struct gridctl_archive_query *query,
+             GridctlArchiveSampleFunc func,
+             gpointer user_data,
+             guint64 *n_samples)
+{
+    const guint8 *p = (const guint8 *)(header + 1);
+    const guint8 *end = p + GUINT32_FROM_LE(header->payload_size);
+    guint n = GUINT16_FROM_LE(header->n_samples);
+    struct gridctl_archive_sample sample = {
+        .channel = header->channel,
+        .fan_type = header->fan_type,
+    };
+    gint64 delta = 0;
+
+    for (guint i = 0; i < n; i++) {
+        guint64 fields[4];
+
+        for (gsize f = 0; f < G_N_ELEMENTS(fields); f++) {
+            if (!get_varint(&p, end, &fields[f])) {
+                g_warning("Corrupt archive block: sample %u of %u is truncated", i, n);
+                return TRUE;
+            }
+        }
+
+        if (i == 0) {
+            sample.time = zigzag_decode(fields[0]);
+            sample.rpm = (guint16)fields[1];
+            sample.voltage_mv = (guint32)fields[2];
+            sample.current_ma = (guint32)fields[3];
+        } else {
+            delta += zigzag_decode(fields[0]);
+            sample.time += delta;
+            sample.rpm = (guint16)(sample.rpm + zigzag_decode(fields[1]));
+            sample.voltage_mv = (guint32)(sample.voltage_mv + zigzag_decode(fields[2]));
+            sample.current_ma = (guint32)(sample.current_ma + zigzag_decode(fields[3]));
+        }
+
+        if (sample.time < query->time_from || sample.time > query->time_to
+            || sample.rpm < query->rpm_min || sample.rpm > query->rpm_max)
+        {
+            continue;
+        }
+
+        (*n_samples)++;
+        if (!func(&sample, user_data)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Binary search for the first block that can contain samples at or after time */
+static guint
+index_lower_bound(GridctlArchiveReader *reader, const struct archive_index *index, gint64 time)
+{
+    guint begin = 0;
+    guint end = index->blocks->len;
+
+    while (begin < end) {
+        guint middle = begin + (end - begin) / 2;
+        const struct gridctl_archive_block_header *header
+            = reader_get_block(reader, g_array_index(index->blocks, guint32, middle));
+
+        if ((gint64)GINT64_FROM_LE(header->time_max) < time) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+
+    return begin;
+}
+
+static gboolean
+query_index(GridctlArchiveReader *reader,
+            const struct archive_index *index,
+            const struct gridctl_archive_query *query,
+            GridctlArchiveSampleFunc func,
+            gpointer user_data,
+            struct gridctl_archive_stats *stats)
+{
+    guint first = index->ordered ? index_lower_bound(reader, index, query->time_from) : 0;
+    guint64 n_visited = 0;
+    gboolean complete = TRUE;
+
+    for (guint i = first; i < index->blocks->len && complete; i++) {
+        const struct gridctl_archive_block_header *header
+            = reader_get_block(reader, g_array_index(index->blocks, guint32, i));
+
+        if (index->ordered && (gint64)GINT64_FROM_LE(header->time_min) > query->time_to) {
+            break;
+        }
+
+        if (header_matches(header, query)) {
+            n_visited++;
+            complete = decode_block(header, query, func, user_data, &stats->n_samples);
+        }
+    }
+
+    stats->n_blocks_skipped = stats->n_blocks - n_visited;
+    return complete;
+}
+
+/*
+ * Calls func for every sample matching query, in file order (i.e. by time within a channel).
+ * Returns FALSE if func returned FALSE to stop early. stats, if not NULL, receives the number of
+ * blocks in the file and how many of them were skipped, and the number of samples passed to func.
+ *
+ * Single-channel queries binary search the channel's block index; the others scan every block
+ * header, which is still cheap compared to decoding.
+ */
+gboolean
+gridctl_archive_reader_query(GridctlArchiveReader *reader,
+                             const struct gridctl_archive_query *query,
+                             GridctlArchiveSampleFunc func,
+                             gpointer user_data,
+                             struct gridctl_archive_stats *stats)
+{
+    struct gridctl_archive_stats query_stats = {
+        .n_blocks = reader->n_blocks,
+        .file_size = reader->size,
+    };
+    gboolean complete = TRUE;
+
+    if (query->channel < NZXT_GRID_V3_CHANNEL_COUNT) {
+        complete = query_index(
+            reader, &reader->index[query->channel], query, func, user_data, &query_stats);
+    } else if (query->channel == GRIDCTL_ARCHIVE_ANY_CHANNEL) {
+        for (guint64 i = 0; i < reader->n_blocks && complete; i++) {
+            const struct gridctl_archive_block_header *header = reader_get_block(reader, i);
+
+            if (!header || !header_matches(header, query)) {
+                query_stats.n_blocks_skipped++;
+                continue;
+            }
+
+            complete = decode_block(header, query, func, user_data, &query_stats.n_samples);
+        }
+    } else {
+        query_stats.n_blocks_skipped = reader->n_blocks;
+    }
+
+    if (stats) {
+        *stats = query_stats;
+    }
+
+    return complete;
+}
+
+void
+gridctl_archive_reader_get_stats(GridctlArchiveReader *reader, struct gridctl_archive_stats *stats)
+{
+    *stats = (struct gridctl_archive_stats){
+        .n_blocks = reader->n_blocks,
+        .n_samples = reader->n_samples,
+        .file_size = reader->size,
+    };
+}
+
+void
+gridctl_archive_reader_free(GridctlArchiveReader *reader)
+{
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_array_unref(reader->index[channel].blocks);
+    }
+
+    g_mapped_file_unref(reader->file);
+    g_free(reader);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <glib.h>
+
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Long-term per-channel history archive.
+ *
+ * The file is a header followed by fixed-size blocks. Every block holds samples of one channel:
+ * timestamps (milliseconds) as delta-of-delta and RPM/voltage/current as deltas, all zigzag
+ * varints. The block header carries the time and value ranges of its samples, so queries skip
+ * blocks without decoding them. All multi-byte header fields are little-endian.
+ */
+
+#define GRIDCTL_ARCHIVE_MAGIC "GRIDARCH"
+#define GRIDCTL_ARCHIVE_VERSION 1U
+#define GRIDCTL_ARCHIVE_BLOCK_SIZE 4096U
+#define GRIDCTL_ARCHIVE_BLOCK_MAGIC 0x4b424147U /* "GABK" */
+
+#define GRIDCTL_ARCHIVE_ANY_CHANNEL G_MAXUINT
+
+struct gridctl_archive_file_header {
+    gchar magic[8];
+    guint32 version;
+    guint32 block_size;
+    guint8 reserved[48];
+} __attribute__((packed));
+
+struct gridctl_archive_block_header {
+    guint32 magic;
+    guint8 channel;
+    guint8 fan_type;
+    guint16 n_samples;
+    guint32 payload_size;
+    guint32 reserved;
+    gint64 time_min;
+    gint64 time_max;
+    guint16 rpm_min;
+    guint16 rpm_max;
+    guint32 voltage_mv_min;
+    guint32 voltage_mv_max;
+    guint32 current_ma_min;
+    guint32 current_ma_max;
+    guint8 reserved2[12];
+} __attribute__((packed));
+
+G_STATIC_ASSERT(sizeof(struct gridctl_archive_file_header) == 64);
+G_STATIC_ASSERT(sizeof(struct gridctl_archive_block_header) == 64);
+
+struct gridctl_archive_sample {
+    gint64 time; /* milliseconds since the Unix epoch */
+    guint8 channel;
+    guint8 fan_type;
+    guint16 rpm;
+    guint32 voltage_mv;
+    guint32 current_ma;
+};
+
+struct gridctl_archive_query {
+    guint channel;
+    gint64 time_from; /* inclusive, milliseconds */
+    gint64 time_to; /* inclusive, milliseconds */
+    guint16 rpm_min;
+    guint16 rpm_max;
+};
+
+/* Matches every sample; narrow the fields down from there */
+static inline void
+gridctl_archive_query_init(struct gridctl_archive_query *query)
+{
+    query->channel = GRIDCTL_ARCHIVE_ANY_CHANNEL;
+    query->time_from = G_MININT64;
+    query->time_to = G_MAXINT64;
+    query->rpm_min = 0;
+    query->rpm_max = G_MAXUINT16;
+}
+
+struct gridctl_archive_stats {
+    guint64 n_blocks;
+    guint64 n_blocks_skipped; /* queries only: rejected by the block header */
+    guint64 n_samples;
+    guint64 file_size;
+};
+
+typedef gboolean (*GridctlArchiveSampleFunc)(const struct gridctl_archive_sample *sample,
+                                             gpointer user_data);
+
+typedef struct _GridctlArchiveWriter GridctlArchiveWriter;
+
+GridctlArchiveWriter *
+gridctl_archive_writer_new(const gchar *path, GError **error);
+
+gboolean
+gridctl_archive_writer_append(GridctlArchiveWriter *writer,
+                              const struct gridctl_archive_sample *sample,
+                              GError **error);
+
+gboolean
+gridctl_archive_writer_append_report(GridctlArchiveWriter *writer,
+                                     const struct nzxt_grid_status_report *report,
+                                     gint64 real_time,
+                                     GError **error);
+
+gboolean
+gridctl_archive_writer_flush(GridctlArchiveWriter *writer, GError **error);
+
+void
+gridctl_archive_writer_get_stats(GridctlArchiveWriter *writer, struct gridctl_archive_stats *stats);
+
+void
+gridctl_archive_writer_free(GridctlArchiveWriter *writer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GridctlArchiveWriter, gridctl_archive_writer_free)
+
+typedef struct _GridctlArchiveReader GridctlArchiveReader;
+
+GridctlArchiveReader *
+gridctl_archive_reader_new(const gchar *path, GError **error);
+
+gboolean
+gridctl_archive_reader_query(GridctlArchiveReader *reader,
+                             const struct gridctl_archive_query *query,
+                             GridctlArchiveSampleFunc func,
+                             gpointer user_data,
+                             struct gridctl_archive_stats *stats);
+
+void
+gridctl_archive_reader_get_stats(GridctlArchiveReader *reader, struct gridctl_archive_stats *stats);
+
+void
+gridctl_archive_reader_free(GridctlArchiveReader *reader);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GridctlArchiveReader, gridctl_archive_reader_free)
+
+G_END_DECLS
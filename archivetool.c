@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "archive.h"
+
+static gint channel = -1;
+static gint64 time_from = G_MININT64;
+static gint64 time_to = G_MAXINT64;
+static gint rpm_min = 0;
+static gint rpm_max = G_MAXUINT16;
+static gboolean info = FALSE;
+static gint bench_days = 0;
+static gdouble bench_rate = 1.0;
+
+static const GOptionEntry option_entries[] = {
+    { "channel", 'c', 0, G_OPTION_ARG_INT, &channel, "Only print channel N", "N" },
+    { "from", 'f', 0, G_OPTION_ARG_INT64, &time_from, "Start time, ms since the epoch", "MS" },
+    { "to", 't', 0, G_OPTION_ARG_INT64, &time_to, "End time, ms since the epoch", "MS" },
+    { "rpm-min", 0, 0, G_OPTION_ARG_INT, &rpm_min, "Only print samples with RPM >= N", "N" },
+    { "rpm-max", 0, 0, G_OPTION_ARG_INT, &rpm_max, "Only print samples with RPM <= N", "N" },
+    { "info", 'i', 0, G_OPTION_ARG_NONE, &info, "Print size and compression ratio", NULL },
+    { "bench",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &bench_days,
+      "Write DAYS of synthetic data to a new FILE and time appends and queries",
+      "DAYS" },
+    { "bench-rate",
+      0,
+      0,
+      G_OPTION_ARG_DOUBLE,
+      &bench_rate,
+      "Reports per second per channel for --bench (default: 1)",
+      "HZ" },
+    { NULL },
+};
+
+/* 2026-01-01T00:00:00Z, so --bench output is reproducible */
+#define BENCH_START_TIME G_GINT64_CONSTANT(1767225600000)
+#define BENCH_QUERIES 1000
+#define BENCH_QUERY_WINDOW (60 * 60 * 1000)
+
+static void
+print_stats(const struct gridctl_archive_stats *stats)
+{
+    guint64 raw_size = stats->n_samples * sizeof(struct nzxt_grid_status_report);
+
+    printf("blocks: %" G_GUINT64_FORMAT "\n", stats->n_blocks);
+    printf("samples: %" G_GUINT64_FORMAT "\n", stats->n_samples);
+    printf("size: %" G_GUINT64_FORMAT " bytes (%.2f bytes/sample)\n",
+           stats->file_size,
+           stats->n_samples ? (double)stats->file_size / (double)stats->n_samples : 0.0);
+    printf("compression ratio: %.2f (raw reports: %" G_GUINT64_FORMAT " bytes)\n",
+           stats->file_size ? (double)raw_size / (double)stats->file_size : 0.0,
+           raw_size);
+}
+
+static gboolean
+print_sample_cb(const struct gridctl_archive_sample *sample, gpointer user_data)
+{
+    printf("%" G_GINT64_FORMAT ",%u,%u,%u,%u,%u\n",
+           sample->time,
+           sample->channel,
+           sample->fan_type,
+           sample->rpm,
+           sample->voltage_mv,
+           sample->current_ma);
+    return TRUE;
+}
+
+static gboolean
+count_sample_cb(const struct gridctl_archive_sample *sample, gpointer user_data)
+{
+    guint64 *rpm_sum = user_data;
+
+    *rpm_sum += sample->rpm;
+    return TRUE;
+}
+
+/* Fans wander slowly around their set point; supply voltage barely moves */
+static void
+bench_next_sample(GRand *rand, struct gridctl_archive_sample *sample)
+{
+    sample->rpm = (guint16)CLAMP(sample->rpm + g_rand_int_range(rand, -15, 16), 300, 2500);
+    sample->voltage_mv = (guint32)CLAMP(
+        (gint)sample->voltage_mv + 10 * g_rand_int_range(rand, -1, 2), 11800, 12200);
+    sample->current_ma = (guint32)CLAMP(
+        (gint)sample->current_ma + 10 * g_rand_int_range(rand, -1, 2), 50, 500);
+}
+
+static int
+bench(const gchar *path)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+        g_printerr("%s already exists\n", path);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GridctlArchiveWriter) writer = gridctl_archive_writer_new(path, &error);
+    if (!writer) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GRand) rand = g_rand_new_with_seed(0);
+    struct gridctl_archive_sample samples[NZXT_GRID_V3_CHANNEL_COUNT];
+    gint64 interval = (gint64)(1000 / bench_rate);
+    gint64 n_rounds = (gint64)bench_days * 24 * 60 * 60 * 1000 / interval;
+    gint64 end_time = BENCH_START_TIME + n_rounds * interval;
+
+    for (guint i = 0; i < NZXT_GRID_V3_CHANNEL_COUNT; i++) {
+        samples[i] = (struct gridctl_archive_sample){
+            .channel = (guint8)i,
+            .fan_type = 2,
+            .rpm = 1200,
+            .voltage_mv = 12000,
+            .current_ma = 200,
+        };
+    }
+
+    gint64 start = g_get_monotonic_time();
+
+    for (gint64 round = 0; round < n_rounds; round++) {
+        for (guint i = 0; i < NZXT_GRID_V3_CHANNEL_COUNT; i++) {
+            /* Reports of one round arrive a few ms apart, with some receive jitter */
+            samples[i].time
+                = BENCH_START_TIME + round * interval + i * 5 + g_rand_int_range(rand, 0, 3);
+            bench_next_sample(rand, &samples[i]);
+
+            if (!gridctl_archive_writer_append(writer, &samples[i], &error)) {
+                g_printerr("%s\n", error->message);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (!gridctl_archive_writer_flush(writer, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    gint64 elapsed = MAX(g_get_monotonic_time() - start, 1);
+    struct gridctl_archive_stats stats;
+    gridctl_archive_writer_get_stats(writer, &stats);
+
+    print_stats(&stats);
+    printf("append: %.0f samples/s\n", (double)stats.n_samples * G_USEC_PER_SEC / elapsed);
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    if (!reader) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    struct gridctl_archive_query query;
+    guint64 rpm_sum = 0;
+
+    gridctl_archive_query_init(&query);
+    start = g_get_monotonic_time();
+    gridctl_archive_reader_query(reader, &query, count_sample_cb, &rpm_sum, &stats);
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    printf("full scan: %.0f samples/s\n", (double)stats.n_samples * G_USEC_PER_SEC / elapsed);
+
+    guint64 n_samples = 0;
+    guint64 n_blocks_skipped = 0;
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < BENCH_QUERIES; i++) {
+        query.channel = g_rand_int_range(rand, 0, NZXT_GRID_V3_CHANNEL_COUNT);
+        query.time_from = BENCH_START_TIME
+                          + (gint64)(g_rand_double(rand) * (end_time - BENCH_START_TIME));
+        query.time_to = query.time_from + BENCH_QUERY_WINDOW;
+
+        gridctl_archive_reader_query(reader, &query, count_sample_cb, &rpm_sum, &stats);
+        n_samples += stats.n_samples;
+        n_blocks_skipped += stats.n_blocks_skipped;
+    }
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    printf("1h range queries: %.0f queries/s, %.1f samples/query, %.2f%% of blocks skipped\n",
+           (double)BENCH_QUERIES * G_USEC_PER_SEC / elapsed,
+           (double)n_samples / BENCH_QUERIES,
+           stats.n_blocks ? 100.0 * n_blocks_skipped / BENCH_QUERIES / stats.n_blocks : 0.0);
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new("FILE");
+    g_autoptr(GError) error = NULL;
+
+    g_option_context_set_summary(context,
+                                 "Print samples from a gridctl --archive file as CSV "
+                                 "(time,channel,fan_type,rpm,voltage_mv,current_ma)");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (argc != 2) {
+        g_printerr("Expected exactly one FILE\n");
+        return EXIT_FAILURE;
+    }
+
+    if (bench_days > 0) {
+        if (bench_rate <= 0 || bench_rate > 1000) {
+            g_printerr("--bench-rate must be in (0, 1000]\n");
+            return EXIT_FAILURE;
+        }
+
+        return bench(argv[1]);
+    }
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(argv[1], &error);
+    if (!reader) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (info) {
+        struct gridctl_archive_stats stats;
+
+        gridctl_archive_reader_get_stats(reader, &stats);
+        print_stats(&stats);
+        return EXIT_SUCCESS;
+    }
+
+    struct gridctl_archive_query query;
+
+    gridctl_archive_query_init(&query);
+    if (channel >= 0) {
+        query.channel = (guint)channel;
+    }
+    query.time_from = time_from;
+    query.time_to = time_to;
+    query.rpm_min = (guint16)CLAMP(rpm_min, 0, G_MAXUINT16);
+    query.rpm_max = (guint16)CLAMP(rpm_max, 0, G_MAXUINT16);
+
+    gridctl_archive_reader_query(reader, &query, print_sample_cb, NULL, NULL);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include "clock.h"
+
+G_DEFINE_TYPE(GridctlClock, gridctl_clock, G_TYPE_OBJECT)
+
+static gint64
+get_time(GridctlClock *clock)
+{
+    return g_get_monotonic_time();
+}
+
+static guint
+add_timeout(GridctlClock *clock, guint interval_ms, GSourceFunc func, gpointer data)
+{
+    return g_timeout_add(interval_ms, func, data);
+}
+
+static guint
+add_timeout_seconds(GridctlClock *clock, guint interval_s, GSourceFunc func, gpointer data)
+{
+    return g_timeout_add_seconds(interval_s, func, data);
+}
+
+static void
+remove_timeout(GridctlClock *clock, guint id)
+{
+    g_source_remove(id);
+}
+
+static void
+gridctl_clock_class_init(GridctlClockClass *class)
+{
+    class->get_time = get_time;
+    class->add_timeout = add_timeout;
+    class->add_timeout_seconds = add_timeout_seconds;
+    class->remove_timeout = remove_timeout;
+}
+
+static void
+gridctl_clock_init(GridctlClock *obj)
+{
+}
+
+/**
+ * gridctl_clock_get_default:
+ *
+ * Returns: (transfer none): the clock backed by g_get_monotonic_time() and the default main context
+ */
+GridctlClock *
+gridctl_clock_get_default(void)
+{
+    static GridctlClock *default_clock = NULL;
+
+    if (g_once_init_enter(&default_clock)) {
+        g_once_init_leave(&default_clock, g_object_new(GRIDCTL_TYPE_CLOCK, NULL));
+    }
+
+    return default_clock;
+}
+
+gint64
+gridctl_clock_get_time(GridctlClock *clock)
+{
+    g_return_val_if_fail(GRIDCTL_IS_CLOCK(clock), 0);
+    return GRIDCTL_CLOCK_GET_CLASS(clock)->get_time(clock);
+}
+
+guint
+gridctl_clock_add_timeout(GridctlClock *clock, guint interval_ms, GSourceFunc func, gpointer data)
+{
+    g_return_val_if_fail(GRIDCTL_IS_CLOCK(clock), 0);
+    return GRIDCTL_CLOCK_GET_CLASS(clock)->add_timeout(clock, interval_ms, func, data);
+}
+
+/* Like g_timeout_add_seconds(), real clocks may coalesce these with other timers */
+guint
+gridctl_clock_add_timeout_seconds(GridctlClock *clock,
+                                  guint interval_s,
+                                  GSourceFunc func,
+                                  gpointer data)
+{
+    g_return_val_if_fail(GRIDCTL_IS_CLOCK(clock), 0);
+    return GRIDCTL_CLOCK_GET_CLASS(clock)->add_timeout_seconds(clock, interval_s, func, data);
+}
+
+void
+gridctl_clock_remove_timeout(GridctlClock *clock, guint id)
+{
+    g_return_if_fail(GRIDCTL_IS_CLOCK(clock));
+    GRIDCTL_CLOCK_GET_CLASS(clock)->remove_timeout(clock, id);
+}
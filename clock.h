@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Time source for gridctl internals. The default clock is the GLib monotonic clock and main loop
+ * timeouts; GridctlVirtualClock replaces both so that timer-driven logic can be run in virtual
+ * time, deterministically and as fast as the CPU allows.
+ */
+
+#define GRIDCTL_TYPE_CLOCK (gridctl_clock_get_type())
+G_DECLARE_DERIVABLE_TYPE(GridctlClock, gridctl_clock, GRIDCTL, CLOCK, GObject)
+
+struct _GridctlClockClass {
+    GObjectClass parent_class;
+
+    gint64 (*get_time)(GridctlClock *clock);
+    guint (*add_timeout)(GridctlClock *clock, guint interval_ms, GSourceFunc func, gpointer data);
+    guint (*add_timeout_seconds)(GridctlClock *clock,
+                                 guint interval_s,
+                                 GSourceFunc func,
+                                 gpointer data);
+    void (*remove_timeout)(GridctlClock *clock, guint id);
+
+    gpointer padding[8];
+};
+
+GridctlClock *
+gridctl_clock_get_default(void);
+
+gint64
+gridctl_clock_get_time(GridctlClock *clock);
+
+guint
+gridctl_clock_add_timeout(GridctlClock *clock, guint interval_ms, GSourceFunc func, gpointer data);
+
+guint
+gridctl_clock_add_timeout_seconds(GridctlClock *clock,
+                                  guint interval_s,
+                                  GSourceFunc func,
+                                  gpointer data);
+
+void
+gridctl_clock_remove_timeout(GridctlClock *clock, guint id);
+
+G_END_DECLS
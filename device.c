@@ -0,0 +1,596 @@
+#include "device.h"
+
+#include "hid.h"
+
+struct _GridctlDevice {
+    GObject parent_instance;
+
+    GInputStream *stream;
+    GridctlClock *clock;
+    GCancellable *cancellable;
+    guint retry_source_id;
+
+    /* Low-power mode: reports queue up in the kernel and are drained every sample_interval ms */
+    guint sample_interval;
+    guint sample_source_id;
+    gboolean queue_full_warned;
+    struct gridctl_channel_stats stats[NZXT_GRID_V3_CHANNEL_COUNT];
+
+    guint64 n_wakeups;
+    guint64 n_reports;
+
+    /* Reused for every read - reports are handed to "report" handlers without copying */
+    union {
+        struct nzxt_grid_status_report status;
+        guint8 bytes[sizeof(struct nzxt_grid_status_report)];
+    } buffer;
+};
+
+G_DEFINE_TYPE(GridctlDevice, gridctl_device, G_TYPE_OBJECT)
+
+/* Upper bound on reports handled per low-power wakeup, so a flood can't starve the main loop */
+static const guint SAMPLE_MAX_DRAIN = 256;
+
+enum { PROP_0, PROP_STREAM, PROP_CLOCK, PROP_SAMPLE_INTERVAL, PROP_COUNT };
+static GParamSpec *props[PROP_COUNT];
+
+enum { SIGNAL_REPORT, SIGNAL_SAMPLE, SIGNAL_CLOSED, SIGNAL_COUNT };
+static guint signals[SIGNAL_COUNT];
+
+static void
+set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    GridctlDevice *device = GRIDCTL_DEVICE(object);
+
+    switch (prop_id) {
+    case PROP_STREAM:
+        device->stream = g_value_dup_object(value);
+        break;
+
+    case PROP_CLOCK:
+        device->clock = g_value_dup_object(value);
+        break;
+
+    case PROP_SAMPLE_INTERVAL:
+        gridctl_device_set_sample_interval(device, g_value_get_uint(value));
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void
+get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    GridctlDevice *device = GRIDCTL_DEVICE(object);
+
+    switch (prop_id) {
+    case PROP_STREAM:
+        g_value_set_object(value, device->stream);
+        break;
+
+    case PROP_CLOCK:
+        g_value_set_object(value, device->clock);
+        break;
+
+    case PROP_SAMPLE_INTERVAL:
+        g_value_set_uint(value, device->sample_interval);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void
+constructed(GObject *object)
+{
+    GridctlDevice *device = GRIDCTL_DEVICE(object);
+
+    if (!device->clock) {
+        device->clock = g_object_ref(gridctl_clock_get_default());
+    }
+
+    G_OBJECT_CLASS(gridctl_device_parent_class)->constructed(object);
+}
+
+static void
+dispose(GObject *object)
+{
+    GridctlDevice *device = GRIDCTL_DEVICE(object);
+
+    if (device->clock) {
+        gridctl_device_stop(device);
+    }
+
+    g_clear_object(&device->stream);
+    g_clear_object(&device->clock);
+
+    G_OBJECT_CLASS(gridctl_device_parent_class)->dispose(object);
+}
+
+static void
+schedule_read(GridctlDevice *device);
+
+static void
+clear_timeout(GridctlDevice *device, guint *id)
+{
+    if (*id) {
+        gridctl_clock_remove_timeout(device->clock, *id);
+        *id = 0;
+    }
+}
+
+static gboolean
+schedule_read_source_cb(gpointer user_data)
+{
+    GridctlDevice *device = GRIDCTL_DEVICE(user_data);
+
+    device->retry_source_id = 0;
+    schedule_read(device);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+update_stats(GridctlDevice *device, const struct nzxt_grid_status_report *report, gint64 time)
+{
+    guint8 channel = nzxt_grid_status_report_get_channel(report);
+    if (channel >= NZXT_GRID_V3_CHANNEL_COUNT) {
+        return;
+    }
+
+    struct gridctl_channel_stats *stats = &device->stats[channel];
+    guint16 rpm = nzxt_grid_status_report_get_rpm(report);
+
+    if (stats->n_reports == 0) {
+        stats->rpm_min = rpm;
+        stats->rpm_max = rpm;
+    } else {
+        stats->rpm_min = MIN(stats->rpm_min, rpm);
+        stats->rpm_max = MAX(stats->rpm_max, rpm);
+    }
+
+    stats->channel = channel;
+    stats->fan_type = nzxt_grid_status_report_get_fan_type(report);
+    stats->rpm = rpm;
+    stats->time = time;
+    stats->n_reports++;
+}
+
+static gboolean
+handle_report(GridctlDevice *device, gssize read_size, gint64 time)
+{
+    const guint8 *data = device->buffer.bytes;
+    if (!nzxt_grid_status_report_is_valid(data, (gsize)read_size)) {
+        g_warning("Unexpected report, id = %u, size = %zd", data[0], read_size);
+        return FALSE;
+    }
+
+    device->n_reports++;
+
+    if (device->sample_source_id) {
+        update_stats(device, &device->buffer.status, time);
+    }
+
+    g_signal_emit(device, signals[SIGNAL_REPORT], 0, &device->buffer.status, time);
+    return TRUE;
+}
+
+static void
+handle_end_of_stream(GridctlDevice *device)
+{
+    gridctl_device_stop(device);
+    g_signal_emit(device, signals[SIGNAL_CLOSED], 0);
+}
+
+/*
+ * Errors after which no read will succeed again. An unplugged hidraw device fails reads with EIO,
+ * which GIO can only report as G_IO_ERROR_FAILED.
+ */
+static gboolean
+is_disconnect_error(const GError *err)
+{
+    if (err->domain != G_IO_ERROR) {
+        return FALSE;
+    }
+
+    switch (err->code) {
+    case G_IO_ERROR_FAILED:
+    case G_IO_ERROR_BROKEN_PIPE:
+    case G_IO_ERROR_NOT_CONNECTED:
+#if GLIB_CHECK_VERSION(2, 74, 0)
+    case G_IO_ERROR_NO_SUCH_DEVICE:
+#endif
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+static void
+read_callback(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    GInputStream *stream = G_INPUT_STREAM(source_object);
+    g_autoptr(GridctlDevice) device = GRIDCTL_DEVICE(user_data);
+    g_autoptr(GError) err = NULL;
+    gssize read_size = g_input_stream_read_finish(stream, res, &err);
+
+    if (g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        return;
+    }
+
+    device->n_wakeups++;
+
+    if (read_size < 0) {
+        g_warning("g_input_stream_read_async: %s", err->message);
+
+        if (is_disconnect_error(err)) {
+            handle_end_of_stream(device);
+            return;
+        }
+
+        device->retry_source_id
+            = gridctl_clock_add_timeout_seconds(device->clock, 1, schedule_read_source_cb, device);
+        return;
+    }
+
+    if (read_size == 0) {
+        handle_end_of_stream(device);
+        return;
+    }
+
+    handle_report(device, read_size, gridctl_clock_get_time(device->clock));
+
+    /* A handler may have stopped the device */
+    if (device->cancellable) {
+        schedule_read(device);
+    }
+}
+
+static gboolean
+sample_source_cb(gpointer user_data)
+{
+    g_autoptr(GridctlDevice) device = g_object_ref(GRIDCTL_DEVICE(user_data));
+    GPollableInputStream *stream = G_POLLABLE_INPUT_STREAM(device->stream);
+    /* The reports were queued at different times, but only the drain time is known */
+    gint64 time = gridctl_clock_get_time(device->clock);
+    guint n_drained = 0;
+
+    device->n_wakeups++;
+
+    for (; n_drained < SAMPLE_MAX_DRAIN; n_drained++) {
+        g_autoptr(GError) err = NULL;
+        gssize read_size = g_pollable_input_stream_read_nonblocking(stream,
+                                                                    device->buffer.bytes,
+                                                                    sizeof(device->buffer.bytes),
+                                                                    device->cancellable,
+                                                                    &err);
+
+        if (read_size < 0) {
+            if (g_error_matches(err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+                break;
+            }
+
+            g_warning("g_pollable_input_stream_read_nonblocking: %s", err->message);
+
+            if (is_disconnect_error(err)) {
+                handle_end_of_stream(device);
+                return G_SOURCE_REMOVE;
+            }
+            break;
+        }
+
+        if (read_size == 0) {
+            handle_end_of_stream(device);
+            return G_SOURCE_REMOVE;
+        }
+
+        handle_report(device, read_size, time);
+
+        /* A handler may have stopped the device */
+        if (!device->cancellable) {
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    /* A full queue drops new reports, so the stats would miss the end of the interval */
+    if (n_drained >= GRIDCTL_HID_QUEUE_LENGTH && !device->queue_full_warned) {
+        g_warning("Read %u reports in one wakeup and a full hidraw queue is %u, newer reports "
+                  "were probably dropped. Use a shorter sample interval",
+                  n_drained,
+                  GRIDCTL_HID_QUEUE_LENGTH);
+        device->queue_full_warned = TRUE;
+    }
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        struct gridctl_channel_stats *stats = &device->stats[channel];
+
+        if (stats->n_reports == 0) {
+            continue;
+        }
+
+        g_signal_emit(device, signals[SIGNAL_SAMPLE], 0, stats);
+        stats->n_reports = 0;
+
+        if (!device->cancellable) {
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+start_sampling(GridctlDevice *device)
+{
+    if (!G_IS_POLLABLE_INPUT_STREAM(device->stream)
+        || !g_pollable_input_stream_can_poll(G_POLLABLE_INPUT_STREAM(device->stream)))
+    {
+        g_warning("Device stream can't be polled, reading every report as it arrives");
+        return FALSE;
+    }
+
+    memset(device->stats, 0, sizeof(device->stats));
+    device->queue_full_warned = FALSE;
+
+    /* Whole-second timeouts are coalesced with other timers by GLib, saving extra wakeups */
+    if (device->sample_interval % 1000 == 0) {
+        device->sample_source_id = gridctl_clock_add_timeout_seconds(
+            device->clock, device->sample_interval / 1000, sample_source_cb, device);
+    } else {
+        device->sample_source_id = gridctl_clock_add_timeout(
+            device->clock, device->sample_interval, sample_source_cb, device);
+    }
+
+    return TRUE;
+}
+
+static void
+schedule_read(GridctlDevice *device)
+{
+    g_input_stream_read_async(device->stream,
+                              device->buffer.bytes,
+                              sizeof(device->buffer.bytes),
+                              G_PRIORITY_DEFAULT,
+                              device->cancellable,
+                              read_callback,
+                              g_object_ref(device));
+}
+
+static void
+gridctl_device_class_init(GridctlDeviceClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+    gobject_class->get_property = get_property;
+    gobject_class->set_property = set_property;
+    gobject_class->constructed = constructed;
+    gobject_class->dispose = dispose;
+
+    props[PROP_STREAM] = g_param_spec_object(
+        "stream", /* const gchar *name */
+        "Stream", /* const gchar *nick */
+        "Input stream that delivers raw HID reports", /* const gchar *blurb */
+        G_TYPE_INPUT_STREAM, /* GType object_type */
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+            | G_PARAM_STATIC_STRINGS /* GParamFlags flags */);
+
+    props[PROP_CLOCK] = g_param_spec_object(
+        "clock", /* const gchar *name */
+        "Clock", /* const gchar *nick */
+        "Time source for report timestamps and timeouts", /* const gchar *blurb */
+        GRIDCTL_TYPE_CLOCK, /* GType object_type */
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+            | G_PARAM_STATIC_STRINGS /* GParamFlags flags */);
+
+    props[PROP_SAMPLE_INTERVAL] = g_param_spec_uint(
+        "sample-interval", /* const gchar *name */
+        "Sample Interval", /* const gchar *nick */
+        "Low-power mode: drain queued reports every N milliseconds instead of waking up for "
+        "each one, 0 to disable. Keep it below what the kernel queue holds (64 reports on "
+        "Linux)", /* const gchar *blurb */
+        0, /* guint minimum */
+        G_MAXUINT, /* guint maximum */
+        0, /* guint default_value */
+        G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY
+            | G_PARAM_STATIC_STRINGS /* GParamFlags flags */);
+
+    g_object_class_install_properties(gobject_class, PROP_COUNT, props);
+
+    /**
+     * GridctlDevice::report:
+     * @report: (type gpointer): `const struct nzxt_grid_status_report *`, valid only for the
+     *     duration of the emission
+     * @time: monotonic time (in microseconds) when the report was received. In low-power mode
+     *     that is when the queue was drained, shared by every report read in that wakeup
+     */
+    signals[SIGNAL_REPORT] = g_signal_new("report", /* const gchar *signal_name */
+                                          G_TYPE_FROM_CLASS(class), /* GType itype */
+                                          G_SIGNAL_RUN_LAST, /* GSignalFlags signal_flags */
+                                          0, /* guint class_offset */
+                                          NULL, /* GSignalAccumulator accumulator */
+                                          NULL, /* gpointer accu_data */
+                                          NULL, /* GSignalCMarshaller c_marshaller */
+                                          G_TYPE_NONE, /* GType return_type */
+                                          2, /* guint n_params */
+                                          G_TYPE_POINTER,
+                                          G_TYPE_INT64);
+
+    /**
+     * GridctlDevice::sample:
+     * @stats: (type gpointer): `const struct gridctl_channel_stats *` of one channel, aggregated
+     *     over the last sample interval
+     *
+     * Emitted in low-power mode only, once per interval for every channel that has reported.
+     */
+    signals[SIGNAL_SAMPLE] = g_signal_new("sample", /* const gchar *signal_name */
+                                          G_TYPE_FROM_CLASS(class), /* GType itype */
+                                          G_SIGNAL_RUN_LAST, /* GSignalFlags signal_flags */
+                                          0, /* guint class_offset */
+                                          NULL, /* GSignalAccumulator accumulator */
+                                          NULL, /* gpointer accu_data */
+                                          NULL, /* GSignalCMarshaller c_marshaller */
+                                          G_TYPE_NONE, /* GType return_type */
+                                          1, /* guint n_params */
+                                          G_TYPE_POINTER);
+
+    /**
+     * GridctlDevice::closed:
+     *
+     * Emitted when the stream reaches end of file, e.g. a simulator or a FIFO writer went away,
+     * or fails a read in a way that means the device is gone, e.g. hidraw's EIO after an unplug.
+     * The device is stopped before the emission.
+     */
+    signals[SIGNAL_CLOSED] = g_signal_new("closed", /* const gchar *signal_name */
+                                          G_TYPE_FROM_CLASS(class), /* GType itype */
+                                          G_SIGNAL_RUN_LAST, /* GSignalFlags signal_flags */
+                                          0, /* guint class_offset */
+                                          NULL, /* GSignalAccumulator accumulator */
+                                          NULL, /* gpointer accu_data */
+                                          NULL, /* GSignalCMarshaller c_marshaller */
+                                          G_TYPE_NONE, /* GType return_type */
+                                          0 /* guint n_params */);
+}
+
+static void
+gridctl_device_init(GridctlDevice *obj)
+{
+}
+
+GridctlDevice *
+gridctl_device_new(GInputStream *stream)
+{
+    return g_object_new(GRIDCTL_TYPE_DEVICE, "stream", stream, NULL);
+}
+
+GridctlDevice *
+gridctl_device_new_with_clock(GInputStream *stream, GridctlClock *clock)
+{
+    return g_object_new(GRIDCTL_TYPE_DEVICE, "stream", stream, "clock", clock, NULL);
+}
+
+static void
+open_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    const gchar *path = task_data;
+    GError *error = NULL;
+
+    if (g_task_return_error_if_cancelled(task)) {
+        return;
+    }
+
+    g_autoptr(GInputStream) stream = gridctl_hid_open(path, &error);
+    if (!stream) {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_pointer(task, gridctl_device_new(stream), g_object_unref);
+}
+
+void
+gridctl_device_open_async(const gchar *path,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data)
+{
+    g_autoptr(GTask) task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, gridctl_device_open_async);
+    g_task_set_task_data(task, g_strdup(path), g_free);
+    g_task_run_in_thread(task, open_thread);
+}
+
+GridctlDevice *
+gridctl_device_open_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+GInputStream *
+gridctl_device_get_stream(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), NULL);
+    return device->stream;
+}
+
+GridctlClock *
+gridctl_device_get_clock(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), NULL);
+    return device->clock;
+}
+
+void
+gridctl_device_start(GridctlDevice *device)
+{
+    g_return_if_fail(GRIDCTL_IS_DEVICE(device));
+    g_return_if_fail(device->stream != NULL);
+
+    if (device->cancellable) {
+        return;
+    }
+
+    device->cancellable = g_cancellable_new();
+
+    if (device->sample_interval == 0 || !start_sampling(device)) {
+        schedule_read(device);
+    }
+}
+
+void
+gridctl_device_stop(GridctlDevice *device)
+{
+    g_return_if_fail(GRIDCTL_IS_DEVICE(device));
+
+    clear_timeout(device, &device->retry_source_id);
+    clear_timeout(device, &device->sample_source_id);
+
+    if (device->cancellable) {
+        g_cancellable_cancel(device->cancellable);
+        g_clear_object(&device->cancellable);
+    }
+}
+
+gboolean
+gridctl_device_is_running(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), FALSE);
+    return device->cancellable != NULL;
+}
+
+void
+gridctl_device_set_sample_interval(GridctlDevice *device, guint sample_interval)
+{
+    g_return_if_fail(GRIDCTL_IS_DEVICE(device));
+    g_return_if_fail(!gridctl_device_is_running(device));
+
+    if (device->sample_interval == sample_interval) {
+        return;
+    }
+
+    device->sample_interval = sample_interval;
+    g_object_notify_by_pspec(G_OBJECT(device), props[PROP_SAMPLE_INTERVAL]);
+}
+
+guint
+gridctl_device_get_sample_interval(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), 0);
+    return device->sample_interval;
+}
+
+guint64
+gridctl_device_get_wakeup_count(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), 0);
+    return device->n_wakeups;
+}
+
+guint64
+gridctl_device_get_report_count(GridctlDevice *device)
+{
+    g_return_val_if_fail(GRIDCTL_IS_DEVICE(device), 0);
+    return device->n_reports;
+}
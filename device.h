@@ -0,0 +1,66 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "clock.h"
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/* Per-channel aggregate over one low-power sample interval */
+struct gridctl_channel_stats {
+    guint8 channel;
+    guint8 fan_type;
+    guint16 rpm; /* from the most recent report */
+    guint16 rpm_min;
+    guint16 rpm_max;
+    guint n_reports;
+    gint64 time; /* receive time of the most recent report, i.e. of the last drain */
+};
+
+#define GRIDCTL_TYPE_DEVICE (gridctl_device_get_type())
+G_DECLARE_FINAL_TYPE(GridctlDevice, gridctl_device, GRIDCTL, DEVICE, GObject)
+
+GridctlDevice *
+gridctl_device_new(GInputStream *stream);
+
+GridctlDevice *
+gridctl_device_new_with_clock(GInputStream *stream, GridctlClock *clock);
+
+void
+gridctl_device_open_async(const gchar *path,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+
+GridctlDevice *
+gridctl_device_open_finish(GAsyncResult *result, GError **error);
+
+GInputStream *
+gridctl_device_get_stream(GridctlDevice *device);
+
+GridctlClock *
+gridctl_device_get_clock(GridctlDevice *device);
+
+void
+gridctl_device_start(GridctlDevice *device);
+
+void
+gridctl_device_stop(GridctlDevice *device);
+
+gboolean
+gridctl_device_is_running(GridctlDevice *device);
+
+void
+gridctl_device_set_sample_interval(GridctlDevice *device, guint sample_interval);
+
+guint
+gridctl_device_get_sample_interval(GridctlDevice *device);
+
+guint64
+gridctl_device_get_wakeup_count(GridctlDevice *device);
+
+guint64
+gridctl_device_get_report_count(GridctlDevice *device);
+
+G_END_DECLS
@@ -0,0 +1,137 @@
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "energy.h"
+
+static const gchar KEY_ENERGY[] = "energy_j";
+static const gchar KEY_COMPENSATION[] = "energy_compensation_j";
+
+static void
+compensated_add(gdouble *sum, gdouble *compensation, gdouble value)
+{
+    gdouble t = *sum + value;
+
+    if (fabs(*sum) >= fabs(value)) {
+        *compensation += (*sum - t) + value;
+    } else {
+        *compensation += (value - t) + *sum;
+    }
+
+    *sum = t;
+}
+
+void
+gridctl_energy_meter_init(struct gridctl_energy_meter *meter)
+{
+    memset(meter, 0, sizeof(*meter));
+    meter->max_gap = GRIDCTL_ENERGY_MAX_GAP;
+}
+
+void
+gridctl_energy_meter_set_max_gap(struct gridctl_energy_meter *meter, gint64 max_gap)
+{
+    g_return_if_fail(max_gap > 0);
+    meter->max_gap = max_gap;
+}
+
+void
+gridctl_energy_meter_add_report(struct gridctl_energy_meter *meter,
+                                const struct nzxt_grid_status_report *report,
+                                gint64 time)
+{
+    guint8 channel_index = nzxt_grid_status_report_get_channel(report);
+    if (channel_index >= NZXT_GRID_V3_CHANNEL_COUNT) {
+        return;
+    }
+
+    struct gridctl_energy_channel *channel = &meter->channels[channel_index];
+    gdouble power_w = nzxt_grid_status_report_get_voltage_mv(report)
+                      * (gdouble)nzxt_grid_status_report_get_current_ma(report) / 1e6;
+    gint64 dt = time - channel->last_time;
+
+    if (channel->has_last && dt > 0 && dt <= meter->max_gap) {
+        gdouble energy_j = (channel->power_w + power_w) / 2 * (gdouble)dt / G_USEC_PER_SEC;
+        compensated_add(&channel->energy_j, &channel->energy_compensation_j, energy_j);
+    }
+
+    channel->power_w = power_w;
+    channel->has_last = TRUE;
+    channel->last_time = time;
+}
+
+gdouble
+gridctl_energy_meter_get_power(const struct gridctl_energy_meter *meter, guint channel)
+{
+    g_return_val_if_fail(channel < NZXT_GRID_V3_CHANNEL_COUNT, 0);
+    return meter->channels[channel].power_w;
+}
+
+gdouble
+gridctl_energy_meter_get_energy(const struct gridctl_energy_meter *meter, guint channel)
+{
+    g_return_val_if_fail(channel < NZXT_GRID_V3_CHANNEL_COUNT, 0);
+
+    const struct gridctl_energy_channel *state = &meter->channels[channel];
+    return state->energy_j + state->energy_compensation_j;
+}
+
+static gchar *
+channel_group(guint channel)
+{
+    return g_strdup_printf("channel%u", channel);
+}
+
+/* Restores energy totals only - report times are monotonic and meaningless after a restart */
+gboolean
+gridctl_energy_meter_load(struct gridctl_energy_meter *meter, const gchar *path, GError **error)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) {
+        return FALSE;
+    }
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_autofree gchar *group = channel_group(channel);
+        GError *channel_error = NULL;
+
+        if (!g_key_file_has_group(key_file, group)) {
+            continue;
+        }
+
+        gdouble energy_j = g_key_file_get_double(key_file, group, KEY_ENERGY, &channel_error);
+        if (channel_error) {
+            g_propagate_error(error, channel_error);
+            return FALSE;
+        }
+
+        /* Missing compensation term is fine, it's only a correction */
+        gdouble compensation_j = g_key_file_get_double(key_file, group, KEY_COMPENSATION, NULL);
+
+        meter->channels[channel].energy_j = energy_j;
+        meter->channels[channel].energy_compensation_j = compensation_j;
+    }
+
+    return TRUE;
+}
+
+gboolean
+gridctl_energy_meter_save(const struct gridctl_energy_meter *meter,
+                          const gchar *path,
+                          GError **error)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_autofree gchar *group = channel_group(channel);
+        const struct gridctl_energy_channel *state = &meter->channels[channel];
+
+        g_key_file_set_double(key_file, group, KEY_ENERGY, state->energy_j);
+        g_key_file_set_double(key_file, group, KEY_COMPENSATION, state->energy_compensation_j);
+    }
+
+    /* Written to a temporary file and renamed, so a crash never leaves a torn checkpoint */
+    return g_key_file_save_to_file(key_file, path, error);
+}
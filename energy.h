@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glib.h>
+
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Per-channel power and energy accounting from the voltage and current in status reports.
+ *
+ * Energy is integrated with the trapezoidal rule between consecutive reports of a channel, using
+ * compensated (Neumaier) summation so that totals over months don't drift. Adding a report is O(1)
+ * and never allocates.
+ */
+
+/*
+ * Reports further apart than this are not integrated across - the device was likely gone. It's
+ * the default, a meter fed at a longer sample interval has to raise its own.
+ */
+#define GRIDCTL_ENERGY_MAX_GAP (10 * G_USEC_PER_SEC)
+
+struct gridctl_energy_channel {
+    gboolean has_last; /* FALSE until the first report */
+    gint64 last_time;
+    gdouble power_w;
+    gdouble energy_j;
+    gdouble energy_compensation_j;
+};
+
+struct gridctl_energy_meter {
+    struct gridctl_energy_channel channels[NZXT_GRID_V3_CHANNEL_COUNT];
+    gint64 max_gap;
+};
+
+void
+gridctl_energy_meter_init(struct gridctl_energy_meter *meter);
+
+void
+gridctl_energy_meter_set_max_gap(struct gridctl_energy_meter *meter, gint64 max_gap);
+
+void
+gridctl_energy_meter_add_report(struct gridctl_energy_meter *meter,
+                                const struct nzxt_grid_status_report *report,
+                                gint64 time);
+
+gdouble
+gridctl_energy_meter_get_power(const struct gridctl_energy_meter *meter, guint channel);
+
+gdouble
+gridctl_energy_meter_get_energy(const struct gridctl_energy_meter *meter, guint channel);
+
+gboolean
+gridctl_energy_meter_load(struct gridctl_energy_meter *meter, const gchar *path, GError **error);
+
+gboolean
+gridctl_energy_meter_save(const struct gridctl_energy_meter *meter,
+                          const gchar *path,
+                          GError **error);
+
+G_END_DECLS
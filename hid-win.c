@@ -10,65 +10,13 @@
 #include <hidsdi.h>
 #include <setupapi.h>
 
+#include "hid.h"
 #include "nzxtgridproto.h"
 #include "winhidinputstream.h"
 
 G_DEFINE_AUTO_CLEANUP_FREE_FUNC(HANDLE, CloseHandle, INVALID_HANDLE_VALUE);
 G_DEFINE_AUTO_CLEANUP_FREE_FUNC(HDEVINFO, SetupDiDestroyDeviceInfoList, INVALID_HANDLE_VALUE);
 
-static void
-read_callback(GObject *source_object, GAsyncResult *res, gpointer user_data);
-
-static void
-schedule_read(GInputStream *stream)
-{
-    static const gsize BUFFER_SIZE = sizeof(struct nzxt_grid_status_report);
-    void *data = g_malloc(BUFFER_SIZE);
-
-    g_input_stream_read_async(stream,
-                              data,
-                              BUFFER_SIZE,
-                              G_PRIORITY_DEFAULT,
-                              NULL,
-                              read_callback,
-                              data);
-}
-
-static gboolean
-schedule_read_source_cb(gpointer user_data)
-{
-    schedule_read(G_INPUT_STREAM(user_data));
-    return FALSE;
-}
-
-static void
-read_callback(GObject *source_object, GAsyncResult *res, gpointer user_data)
-{
-    GInputStream *stream = G_INPUT_STREAM(source_object);
-    g_autoptr(GError) err = NULL;
-    guint8 *data = (guint8 *)user_data;
-    gssize read_size = g_input_stream_read_finish(stream, res, &err);
-
-    if (read_size < 0) {
-        g_warning("g_input_stream_read_async: %s", err->message);
-        g_timeout_add_seconds(1, schedule_read_source_cb, stream);
-        return;
-    }
-
-    if (data[0] != NZXT_GRID_STATUS_REPORT_ID
-        || read_size != sizeof(struct nzxt_grid_status_report)) {
-        g_warning("Unexpected report, id = %u, size = %zu\n", data[0], read_size);
-        schedule_read(stream);
-        return;
-    }
-
-    struct nzxt_grid_status_report *status_report = (struct nzxt_grid_status_report *)data;
-    g_message("status: channel %u rpm=%u",
-              nzxt_grid_status_report_get_channel(status_report),
-              nzxt_grid_status_report_get_rpm(status_report));
-    schedule_read(stream);
-}
-
 static gchar *
 wchar_t_to_utf8(const wchar_t *str)
 {
@@ -80,8 +28,8 @@ wchar_t_to_utf8(const wchar_t *str)
     return str_utf8;
 }
 
-static gchar *
-find_grid_device()
+gchar *
+gridctl_hid_find_grid_device(void)
 {
     GUID hid_guid;
     HidD_GetHidGuid(&hid_guid);
@@ -175,6 +123,13 @@ find_grid_device()
     return NULL;
 }
 
+static void
+set_win32_error(GError **error, const gchar *func)
+{
+    g_autofree gchar *err_message = g_win32_error_message(GetLastError());
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s: %s", func, err_message);
+}
+
 static void
 hid_preparsed_data_cleanup(PHIDP_PREPARSED_DATA *data)
 {
@@ -190,13 +145,11 @@ hid_preparsed_data_cleanup(PHIDP_PREPARSED_DATA *data)
     }
 }
 
-static GInputStream *
-open_device(const gchar *path)
+GInputStream *
+gridctl_hid_open(const gchar *path, GError **error)
 {
-    g_autoptr(GError) error = NULL;
-    g_autofree wchar_t *path_wchar = g_utf8_to_utf16(path, -1, NULL, NULL, &error);
+    g_autofree wchar_t *path_wchar = g_utf8_to_utf16(path, -1, NULL, NULL, error);
     if (!path_wchar) {
-        g_warning("g_utf8_to_utf16: %s", error->message);
         return NULL;
     }
 
@@ -208,21 +161,19 @@ open_device(const gchar *path)
                                         FILE_FLAG_OVERLAPPED, /* DWORD dwFlagsAndAttributes */
                                         NULL /* HANDLE hTemplateFile */);
     if (device == INVALID_HANDLE_VALUE) {
-        g_autofree gchar *err_message = g_win32_error_message(GetLastError());
-        g_warning("CreateFileW: %s", err_message);
+        set_win32_error(error, "CreateFileW");
         return NULL;
     }
 
     __attribute__((cleanup(hid_preparsed_data_cleanup))) PHIDP_PREPARSED_DATA preparsed_data = NULL;
     if (!HidD_GetPreparsedData(device, &preparsed_data)) {
-        g_autofree gchar *err_message = g_win32_error_message(GetLastError());
-        g_warning("HidD_GetPreparsedData: %s", err_message);
+        set_win32_error(error, "HidD_GetPreparsedData");
         return NULL;
     }
 
     HIDP_CAPS caps;
     if (HidP_GetCaps(preparsed_data, &caps) != HIDP_STATUS_SUCCESS) {
-        g_warning("HidP_GetCaps failed");
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, "HidP_GetCaps failed");
         return NULL;
     }
 
@@ -230,29 +181,7 @@ open_device(const gchar *path)
         = gridctl_win_hid_input_stream_new(device, TRUE, caps.InputReportByteLength);
     device = INVALID_HANDLE_VALUE; /* for handle_cleanup() - handle ownership passed to stream */
 
-    g_message("Device %s opened", path);
+    g_debug("Device %s opened", path);
 
     return stream;
 }
-
-int
-main(void)
-{
-    g_autofree gchar *device_path = find_grid_device();
-    if (!device_path) {
-        g_warning("Can't find NZXT Grid device");
-        return EXIT_FAILURE;
-    }
-
-    g_autoptr(GInputStream) input_stream = open_device(device_path);
-    if (!input_stream) {
-        g_warning("Can't open device");
-        return EXIT_FAILURE;
-    }
-
-    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
-    schedule_read(input_stream);
-    g_main_loop_run(loop);
-
-    return EXIT_SUCCESS;
-}
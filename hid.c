@@ -0,0 +1,70 @@
+#include <errno.h>
+#include <stdio.h>
+
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+
+#include <gudev/gudev.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "hid.h"
+#include "nzxtgridproto.h"
+
+gchar *
+gridctl_hid_find_grid_device(void)
+{
+    g_autoptr(GUdevClient) client = g_udev_client_new(NULL);
+    g_autolist(GUdevDevice) devices = g_udev_client_query_by_subsystem(client, "hidraw");
+
+    for (GList *l = devices; l != NULL; l = l->next) {
+        GUdevDevice *hidraw_dev = G_UDEV_DEVICE(l->data);
+        g_autoptr(GUdevDevice) hid_dev
+            = g_udev_device_get_parent_with_subsystem(hidraw_dev, "hid", NULL);
+
+        if (!hid_dev) {
+            g_warning("Can't find parent hid device for hidraw device");
+            continue;
+        }
+
+        const gchar *id = g_udev_device_get_property(hid_dev, "HID_ID");
+        unsigned bus_type;
+        unsigned short vendor_id, product_id;
+
+        int n_fields = sscanf(id, "%x:%hx:%hx", &bus_type, &vendor_id, &product_id);
+        if (n_fields != 3) {
+            g_warning("Can't parse %s as HID ID, skipping device", id);
+            continue;
+        }
+
+        g_debug("Found device %x:%x", vendor_id, product_id);
+
+        if (vendor_id == USB_VENDOR_ID_NZXT && product_id == USB_PRODUCT_ID_NZXT_GRID_V3) {
+            return g_strdup(g_udev_device_get_device_file(hidraw_dev));
+        }
+    }
+
+    return NULL;
+}
+
+GInputStream *
+gridctl_hid_open(const gchar *path, GError **error)
+{
+    /* Read-only: a FIFO opened for writing by us would never report end of file */
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_IO_ERROR,
+                    g_io_error_from_errno(errsv),
+                    "Can't open %s: %s",
+                    path,
+                    g_strerror(errsv));
+        return NULL;
+    }
+
+    return g_unix_input_stream_new(fd, TRUE);
+}
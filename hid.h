@@ -0,0 +1,24 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Unread reports the OS keeps per open device - HIDRAW_BUFFER_SIZE on Linux, the
+ * HidD_SetNumInputBuffers() default on Windows. Reports that arrive while the queue is full are
+ * lost, which bounds how long a reader can leave the device alone.
+ */
+#ifdef G_OS_WIN32
+#define GRIDCTL_HID_QUEUE_LENGTH 32
+#else
+#define GRIDCTL_HID_QUEUE_LENGTH 64
+#endif
+
+gchar *
+gridctl_hid_find_grid_device(void);
+
+GInputStream *
+gridctl_hid_open(const gchar *path, GError **error);
+
+G_END_DECLS
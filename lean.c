@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "nzxtgridproto.h"
+
+/*
+ * gridctl without GIO and gudev, built with -Dlean=true. Only nzxtgridproto.h is shared with the
+ * regular build: glib.h is included for its types and byte order macros, nothing is linked.
+ */
+
+#define SYSFS_HIDRAW_DIR "/sys/class/hidraw"
+
+static gboolean
+uevent_matches_grid(const char *uevent_path)
+{
+    FILE *uevent = fopen(uevent_path, "re");
+    if (!uevent) {
+        return FALSE;
+    }
+
+    char line[256];
+    gboolean matches = FALSE;
+
+    while (fgets(line, sizeof(line), uevent)) {
+        unsigned bus_type, vendor_id, product_id;
+
+        if (sscanf(line, "HID_ID=%x:%x:%x", &bus_type, &vendor_id, &product_id) == 3) {
+            matches = vendor_id == USB_VENDOR_ID_NZXT && product_id == USB_PRODUCT_ID_NZXT_GRID_V3;
+            break;
+        }
+    }
+
+    fclose(uevent);
+    return matches;
+}
+
+static gboolean
+find_grid_device(char *path, size_t path_size)
+{
+    DIR *dir = opendir(SYSFS_HIDRAW_DIR);
+    if (!dir) {
+        perror("opendir(" SYSFS_HIDRAW_DIR ")");
+        return FALSE;
+    }
+
+    gboolean found = FALSE;
+    struct dirent *entry;
+
+    while (!found && (entry = readdir(dir)) != NULL) {
+        char uevent_path[PATH_MAX];
+
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        snprintf(uevent_path,
+                 sizeof(uevent_path),
+                 SYSFS_HIDRAW_DIR "/%s/device/uevent",
+                 entry->d_name);
+
+        if (uevent_matches_grid(uevent_path)) {
+            snprintf(path, path_size, "/dev/%s", entry->d_name);
+            found = TRUE;
+        }
+    }
+
+    closedir(dir);
+    return found;
+}
+
+static int
+read_loop(int fd)
+{
+    union {
+        struct nzxt_grid_status_report status;
+        guint8 bytes[sizeof(struct nzxt_grid_status_report)];
+    } buffer;
+    struct pollfd pfd = {
+        .fd = fd,
+        .events = POLLIN,
+    };
+
+    for (;;) {
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return EXIT_FAILURE;
+        }
+
+        ssize_t read_size = read(fd, buffer.bytes, sizeof(buffer.bytes));
+
+        if (read_size < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            perror("read");
+            sleep(1);
+            continue;
+        }
+
+        if (read_size == 0) {
+            fprintf(stderr, "Device closed\n");
+            return EXIT_SUCCESS;
+        }
+
+        if (!nzxt_grid_status_report_is_valid(buffer.bytes, (gsize)read_size)) {
+            fprintf(stderr, "Unexpected report, id = %u, size = %zd\n", buffer.bytes[0], read_size);
+            continue;
+        }
+
+        printf("status: channel %u rpm=%u\n",
+               nzxt_grid_status_report_get_channel(&buffer.status),
+               nzxt_grid_status_report_get_rpm(&buffer.status));
+    }
+}
+
+static void
+usage(FILE *out, const char *argv0)
+{
+    fprintf(out,
+            "Usage: %s [--device PATH]\n"
+            "\n"
+            "  -d, --device PATH  Read reports from PATH instead of looking for the device\n",
+            argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "device", required_argument, NULL, 'd' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    char device_path[PATH_MAX] = "";
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "d:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            snprintf(device_path, sizeof(device_path), "%s", optarg);
+            break;
+
+        case 'h':
+            usage(stdout, argv[0]);
+            return EXIT_SUCCESS;
+
+        default:
+            usage(stderr, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!device_path[0] && !find_grid_device(device_path, sizeof(device_path))) {
+        fprintf(stderr, "Can't find NZXT Grid device\n");
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(device_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(device_path);
+        return EXIT_FAILURE;
+    }
+
+    /* One line per report, even when piped */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    int status = read_loop(fd);
+    close(fd);
+    return status;
+}
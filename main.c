@@ -1,137 +1,759 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <gio/gio.h>
+
+#ifdef G_OS_UNIX
 #include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+#include <glib-unix.h>
+
+#include <signal.h>
+
+#include "shm.h"
+#endif
+
+#ifdef G_OS_WIN32
+#include <gio/gwin32outputstream.h>
+
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "archive.h"
+#include "device.h"
+#include "energy.h"
+#include "hid.h"
+#include "recordwriter.h"
+
+struct gridctl_app {
+    GMainLoop *loop;
+    GridctlClock *clock;
+    GridctlDevice *device;
+    gchar *device_path;
+    int exit_status;
+
+    gint64 stats_time;
+    guint64 stats_wakeups;
+    guint64 stats_reports;
+
+    struct gridctl_energy_meter energy;
+
+    gint64 real_time_offset; /* clock time to real time */
+    gint64 real_time_offset_time; /* report time the offset was last taken at */
+
+    GridctlArchiveWriter *archive_writer;
+    GridctlRecordWriter *record_writer;
+
+    struct nzxt_grid_status_report snapshot[NZXT_GRID_V3_CHANNEL_COUNT];
+    guint snapshot_channels; /* bitmask */
+    guint snapshot_timeout_id;
+
+#ifdef G_OS_UNIX
+    GridctlShmWriter *shm_writer;
+#endif
+};
 
-#include <gudev/gudev.h>
+static gchar *device_path_override = NULL;
+static gboolean reconnect = FALSE;
+static gint sample_interval = 0;
+static gint stats_interval = 0;
+static gchar *energy_state_path = NULL;
+static gint energy_checkpoint_interval = 60;
+static gboolean snapshot = FALSE;
+static gint snapshot_timeout = 2000;
+static gchar *archive_path = NULL;
+static gchar *output_format = NULL;
+static gchar *output_path = NULL;
+static gint output_latency = 100;
 
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
+/* Partial blocks are padded on flush, so don't do it too often */
+#define ARCHIVE_FLUSH_INTERVAL (60 * 60)
 
-#include "nzxtgridproto.h"
+#ifdef G_OS_UNIX
+static gint device_fd = -1;
+static gchar *shm_name = NULL;
+#endif
+
+static const GOptionEntry option_entries[] = {
+    { "device",
+      'd',
+      0,
+      G_OPTION_ARG_FILENAME,
+      &device_path_override,
+      "Read reports from PATH instead of looking for the device (e.g. gridctl-sim output)",
+      "PATH" },
+#ifdef G_OS_UNIX
+    { "device-fd",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &device_fd,
+      "Read reports from an inherited file descriptor, e.g. a gridctl-sim socket",
+      "FD" },
+#endif
+    { "energy-state",
+      0,
+      0,
+      G_OPTION_ARG_FILENAME,
+      &energy_state_path,
+      "Account per-channel power and energy, keeping totals in PATH across restarts",
+      "PATH" },
+    { "energy-checkpoint",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &energy_checkpoint_interval,
+      "Save energy totals every SEC seconds (default: 60)",
+      "SEC" },
+    { "archive",
+      0,
+      0,
+      G_OPTION_ARG_FILENAME,
+      &archive_path,
+      "Append every report to the compressed history archive PATH (see gridctl-archive)",
+      "PATH" },
+    { "output",
+      'o',
+      0,
+      G_OPTION_ARG_STRING,
+      &output_format,
+      "Print every report as a record instead of logging it, FORMAT is ndjson or csv",
+      "FORMAT" },
+    { "output-file",
+      0,
+      0,
+      G_OPTION_ARG_FILENAME,
+      &output_path,
+      "Append --output records to PATH instead of stdout",
+      "PATH" },
+    { "output-latency",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &output_latency,
+      "Write --output records at most MS milliseconds after they're received (default: 100)",
+      "MS" },
+    { "snapshot",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &snapshot,
+      "Print every channel as JSON once all of them have reported, then exit",
+      NULL },
+    { "timeout",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &snapshot_timeout,
+      "Give up on --snapshot after MS milliseconds (default: 2000)",
+      "MS" },
+    { "reconnect",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &reconnect,
+      "Reopen the device when it reaches end of file, is unplugged or can't be opened instead of "
+      "exiting",
+      NULL },
+    { "sample-interval",
+      'i',
+      0,
+      G_OPTION_ARG_INT,
+      &sample_interval,
+      "Low-power mode: wake up every MS milliseconds and report per-channel min/max. Reports "
+      "read in one wakeup share its time, and at most 64 are queued in between",
+      "MS" },
+    { "stats",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &stats_interval,
+      "Log wakeups and reports per second every SEC seconds",
+      "SEC" },
+#ifdef G_OS_UNIX
+    { "shm",
+      0,
+      0,
+      G_OPTION_ARG_STRING,
+      &shm_name,
+      "Publish channel state to shared memory segment NAME (e.g. " GRIDCTL_SHM_DEFAULT_NAME ")",
+      "NAME" },
+#endif
+    { NULL },
+};
 
 static void
-read_callback(GObject *source_object, GAsyncResult *res, gpointer user_data);
+report_cb(GridctlDevice *device,
+          const struct nzxt_grid_status_report *status_report,
+          gint64 time,
+          gpointer user_data)
+{
+    g_message("status: channel %u rpm=%u",
+              nzxt_grid_status_report_get_channel(status_report),
+              nzxt_grid_status_report_get_rpm(status_report));
+}
 
 static void
-schedule_read(GInputStream *stream)
+sample_cb(GridctlDevice *device, const struct gridctl_channel_stats *stats, gpointer user_data)
+{
+    g_message("status: channel %u rpm=%u min=%u max=%u reports=%u",
+              stats->channel,
+              stats->rpm,
+              stats->rpm_min,
+              stats->rpm_max,
+              stats->n_reports);
+}
+
+static gboolean
+stats_cb(gpointer user_data)
 {
-    static const gsize BUFFER_SIZE = sizeof(struct nzxt_grid_status_report);
-    void *data = g_malloc(BUFFER_SIZE);
+    struct gridctl_app *app = user_data;
+
+    if (!app->device) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    gint64 now = gridctl_clock_get_time(app->clock);
+    guint64 wakeups = gridctl_device_get_wakeup_count(app->device);
+    guint64 reports = gridctl_device_get_report_count(app->device);
+
+    if (app->stats_time) {
+        double elapsed = (double)(now - app->stats_time) / G_USEC_PER_SEC;
 
-    g_input_stream_read_async(stream,
-                              data,
-                              BUFFER_SIZE,
-                              G_PRIORITY_DEFAULT,
-                              NULL,
-                              read_callback,
-                              data);
+        g_message("stats: %.2f wakeups/s, %.2f reports/s",
+                  (double)(wakeups - app->stats_wakeups) / elapsed,
+                  (double)(reports - app->stats_reports) / elapsed);
+    }
+
+    app->stats_time = now;
+    app->stats_wakeups = wakeups;
+    app->stats_reports = reports;
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+energy_report_cb(GridctlDevice *device,
+                 const struct nzxt_grid_status_report *status_report,
+                 gint64 time,
+                 gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+
+    gridctl_energy_meter_add_report(&app->energy, status_report, time);
+}
+
+static void
+save_energy(struct gridctl_app *app)
+{
+    g_autoptr(GError) err = NULL;
+
+    if (!gridctl_energy_meter_save(&app->energy, energy_state_path, &err)) {
+        g_warning("Can't save energy totals: %s", err->message);
+    }
 }
 
 static gboolean
-schedule_read_source_cb(gpointer user_data)
+energy_checkpoint_cb(gpointer user_data)
 {
-    schedule_read(G_INPUT_STREAM(user_data));
-    return FALSE;
+    struct gridctl_app *app = user_data;
+
+    save_energy(app);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_message("energy: channel %u power=%.2fW energy=%.3fWh",
+                  channel,
+                  gridctl_energy_meter_get_power(&app->energy, channel),
+                  gridctl_energy_meter_get_energy(&app->energy, channel) / 3600);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Report times come from a monotonic clock, records and the archive need wall clock time. The
+ * monotonic clock stops during suspend and ignores wall clock steps, so the offset is taken again
+ * for every new report time, i.e. once per read or sampling wakeup.
+ */
+static gint64
+get_report_real_time(struct gridctl_app *app, gint64 time)
+{
+    if (time != app->real_time_offset_time) {
+        app->real_time_offset = g_get_real_time() - gridctl_clock_get_time(app->clock);
+        app->real_time_offset_time = time;
+    }
+
+    return time + app->real_time_offset;
 }
 
 static void
-read_callback(GObject *source_object, GAsyncResult *res, gpointer user_data)
+archive_report_cb(GridctlDevice *device,
+                  const struct nzxt_grid_status_report *status_report,
+                  gint64 time,
+                  gpointer user_data)
 {
-    GInputStream *stream = G_INPUT_STREAM(source_object);
+    struct gridctl_app *app = user_data;
     g_autoptr(GError) err = NULL;
-    guint8 *data = (guint8 *)user_data;
-    gssize read_size = g_input_stream_read_finish(stream, res, &err);
 
-    if (read_size < 0) {
-        g_warning("g_input_stream_read_async: %s", err->message);
-        g_timeout_add_seconds(1, schedule_read_source_cb, stream);
-        return;
+    if (!gridctl_archive_writer_append_report(
+            app->archive_writer, status_report, get_report_real_time(app, time), &err))
+    {
+        g_warning("Can't write to the archive: %s", err->message);
     }
+}
 
-    if (data[0] != NZXT_GRID_STATUS_REPORT_ID
-        || read_size != sizeof(struct nzxt_grid_status_report)) {
-        g_warning("Unexpected report, id = %u, size = %zu\n", data[0], read_size);
-        schedule_read(stream);
-        return;
+static void
+flush_archive(struct gridctl_app *app)
+{
+    g_autoptr(GError) err = NULL;
+
+    if (!gridctl_archive_writer_flush(app->archive_writer, &err)) {
+        g_warning("Can't write to the archive: %s", err->message);
     }
+}
 
-    struct nzxt_grid_status_report *status_report = (struct nzxt_grid_status_report *)data;
-    g_message("status: channel %u rpm=%u",
-              nzxt_grid_status_report_get_channel(status_report),
-              nzxt_grid_status_report_get_rpm(status_report));
-    schedule_read(stream);
+static gboolean
+archive_flush_cb(gpointer user_data)
+{
+    flush_archive(user_data);
+    return G_SOURCE_CONTINUE;
 }
 
-static gchar *
-find_grid_device()
+static void
+record_report_cb(GridctlDevice *device,
+                 const struct nzxt_grid_status_report *status_report,
+                 gint64 time,
+                 gpointer user_data)
 {
-    g_autoptr(GUdevClient) client = g_udev_client_new(NULL);
-    g_autolist(GUdevDevice) devices = g_udev_client_query_by_subsystem(client, "hidraw");
+    struct gridctl_app *app = user_data;
+    g_autoptr(GError) err = NULL;
 
-    for (GList *l = devices; l != NULL; l = l->next) {
-        GUdevDevice *hidraw_dev = G_UDEV_DEVICE(l->data);
-        g_autoptr(GUdevDevice) hid_dev
-            = g_udev_device_get_parent_with_subsystem(hidraw_dev, "hid", NULL);
+    if (!gridctl_record_writer_write_report(
+            app->record_writer, status_report, get_report_real_time(app, time), &err))
+    {
+        g_warning("Can't write records: %s", err->message);
+    }
+}
 
-        if (!hid_dev) {
-            g_warning("Can't find parent hid device for hidraw device");
-            continue;
+static GridctlRecordWriter *
+record_writer_new(GridctlClock *clock, GError **error)
+{
+    GridctlRecordFormat format;
+    g_autoptr(GOutputStream) stream = NULL;
+
+    if (g_str_equal(output_format, "ndjson")) {
+        format = GRIDCTL_RECORD_FORMAT_NDJSON;
+    } else if (g_str_equal(output_format, "csv")) {
+        format = GRIDCTL_RECORD_FORMAT_CSV;
+    } else {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Unknown output format %s, expected ndjson or csv",
+                    output_format);
+        return NULL;
+    }
+
+    if (output_path) {
+        g_autoptr(GFile) file = g_file_new_for_commandline_arg(output_path);
+
+        stream = G_OUTPUT_STREAM(g_file_append_to(file, G_FILE_CREATE_NONE, NULL, error));
+        if (!stream) {
+            return NULL;
         }
+    } else {
+#ifdef G_OS_UNIX
+        stream = g_unix_output_stream_new(fileno(stdout), FALSE);
+#else
+        stream = g_win32_output_stream_new(GetStdHandle(STD_OUTPUT_HANDLE), FALSE);
+#endif
+    }
+
+    return gridctl_record_writer_new(stream, clock, format, (guint)MAX(output_latency, 0));
+}
+
+static void
+flush_records(struct gridctl_app *app)
+{
+    g_autoptr(GError) err = NULL;
 
-        const gchar *id = g_udev_device_get_property(hid_dev, "HID_ID");
-        unsigned bus_type;
-        unsigned short vendor_id, product_id;
+    if (!gridctl_record_writer_flush(app->record_writer, &err)) {
+        g_warning("Can't write records: %s", err->message);
+    }
+}
+
+static void
+finish_snapshot(struct gridctl_app *app, gboolean complete)
+{
+    g_autoptr(GString) json = g_string_new(NULL);
+
+    g_string_append_printf(json, "{\"complete\":%s,\"channels\":[", complete ? "true" : "false");
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        const struct nzxt_grid_status_report *report = &app->snapshot[channel];
 
-        int n_fields = sscanf(id, "%x:%hx:%hx", &bus_type, &vendor_id, &product_id);
-        if (n_fields != 3) {
-            g_warning("Can't parse %s as HID ID, skipping device", id);
+        if (!(app->snapshot_channels & (1U << channel))) {
             continue;
         }
 
-        g_message("Found device %x:%x", vendor_id, product_id);
-
-        if (vendor_id == USB_VENDOR_ID_NZXT && product_id == USB_PRODUCT_ID_NZXT_GRID_V3) {
-            return g_strdup(g_udev_device_get_device_file(hidraw_dev));
+        if (json->str[json->len - 1] != '[') {
+            g_string_append_c(json, ',');
         }
+
+        g_string_append_printf(json,
+                               "{\"channel\":%u,\"fan_type\":%u,\"rpm\":%u,"
+                               "\"voltage_mv\":%u,\"current_ma\":%u}",
+                               channel,
+                               nzxt_grid_status_report_get_fan_type(report),
+                               nzxt_grid_status_report_get_rpm(report),
+                               nzxt_grid_status_report_get_voltage_mv(report),
+                               nzxt_grid_status_report_get_current_ma(report));
     }
 
-    return NULL;
+    g_string_append(json, "]}\n");
+    fputs(json->str, stdout);
+    fflush(stdout);
+
+    if (app->snapshot_timeout_id) {
+        gridctl_clock_remove_timeout(app->clock, app->snapshot_timeout_id);
+        app->snapshot_timeout_id = 0;
+    }
+    if (app->device) {
+        gridctl_device_stop(app->device);
+    }
+
+    app->exit_status = complete ? EXIT_SUCCESS : EXIT_FAILURE;
+    g_main_loop_quit(app->loop);
 }
 
-static GInputStream *
-open_device(const gchar *path)
+static void
+snapshot_report_cb(GridctlDevice *device,
+                   const struct nzxt_grid_status_report *status_report,
+                   gint64 time,
+                   gpointer user_data)
 {
-    int fd = open(path, O_RDWR);
+    struct gridctl_app *app = user_data;
+    guint8 channel = nzxt_grid_status_report_get_channel(status_report);
 
-    if (fd < 0) {
-        perror("open");
-        return NULL;
+    if (channel >= NZXT_GRID_V3_CHANNEL_COUNT) {
+        return;
     }
 
-    return g_unix_input_stream_new(fd, TRUE);
+    /* The device reports channels in rotation, so a repeat means every active one was seen */
+    if (app->snapshot_channels & (1U << channel)) {
+        finish_snapshot(app, TRUE);
+        return;
+    }
+
+    app->snapshot[channel] = *status_report;
+    app->snapshot_channels |= 1U << channel;
+
+    if (app->snapshot_channels == (1U << NZXT_GRID_V3_CHANNEL_COUNT) - 1) {
+        finish_snapshot(app, TRUE);
+    }
+}
+
+static gboolean
+snapshot_timeout_cb(gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+
+    app->snapshot_timeout_id = 0;
+    finish_snapshot(app, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+#ifdef G_OS_UNIX
+static void
+shm_report_cb(GridctlDevice *device,
+              const struct nzxt_grid_status_report *status_report,
+              gint64 time,
+              gpointer user_data)
+{
+    gridctl_shm_writer_publish(user_data, status_report, time);
+}
+
+static gboolean
+quit_signal_cb(gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+
+    app->exit_status = EXIT_SUCCESS;
+    g_main_loop_quit(app->loop);
+    return G_SOURCE_CONTINUE;
+}
+#endif
+
+static void
+open_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
+
+static gboolean
+reopen_cb(gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+
+    gridctl_device_open_async(app->device_path, NULL, open_cb, app);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+closed_cb(GridctlDevice *device, gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+
+    if (snapshot) {
+        finish_snapshot(app, FALSE);
+        return;
+    }
+
+    if (reconnect && app->device_path) {
+        g_message("Device closed, reopening %s", app->device_path);
+        g_clear_object(&app->device);
+
+        /* The next device counts wakeups and reports from 0 */
+        app->stats_time = 0;
+        app->stats_wakeups = 0;
+        app->stats_reports = 0;
+        gridctl_clock_add_timeout_seconds(app->clock, 1, reopen_cb, app);
+        return;
+    }
+
+    g_message("Device closed");
+    app->exit_status = EXIT_SUCCESS;
+    g_main_loop_quit(app->loop);
+}
+
+static void
+start_device(struct gridctl_app *app)
+{
+    g_signal_connect(app->device, "closed", G_CALLBACK(closed_cb), app);
+
+    if (snapshot) {
+        g_signal_connect(app->device, "report", G_CALLBACK(snapshot_report_cb), app);
+        app->snapshot_timeout_id
+            = gridctl_clock_add_timeout(app->clock, snapshot_timeout, snapshot_timeout_cb, app);
+        gridctl_device_start(app->device);
+        return;
+    }
+
+    if (sample_interval > 0) {
+        gridctl_device_set_sample_interval(app->device, sample_interval);
+    }
+
+    /* Reports are still emitted one by one in low-power mode, just in batches */
+    if (app->record_writer) {
+        g_signal_connect(app->device, "report", G_CALLBACK(record_report_cb), app);
+    } else if (sample_interval > 0) {
+        g_signal_connect(app->device, "sample", G_CALLBACK(sample_cb), app);
+    } else {
+        g_signal_connect(app->device, "report", G_CALLBACK(report_cb), app);
+    }
+
+    if (energy_state_path) {
+        g_signal_connect(app->device, "report", G_CALLBACK(energy_report_cb), app);
+    }
+
+    if (app->archive_writer) {
+        g_signal_connect(app->device, "report", G_CALLBACK(archive_report_cb), app);
+    }
+
+#ifdef G_OS_UNIX
+    if (app->shm_writer) {
+        g_signal_connect(app->device, "report", G_CALLBACK(shm_report_cb), app->shm_writer);
+    }
+#endif
+
+    gridctl_device_start(app->device);
+}
+
+static void
+open_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    struct gridctl_app *app = user_data;
+    g_autoptr(GError) err = NULL;
+
+    app->device = gridctl_device_open_finish(res, &err);
+    if (!app->device && reconnect) {
+        /* The node may not be back yet after an unplug, keep trying until we're told to stop */
+        g_warning("Can't open device, retrying: %s", err->message);
+        gridctl_clock_add_timeout_seconds(app->clock, 1, reopen_cb, app);
+        return;
+    }
+
+    if (!app->device) {
+        g_warning("Can't open device: %s", err->message);
+        g_main_loop_quit(app->loop);
+        return;
+    }
+
+    start_device(app);
+}
+
+static void
+app_clear(struct gridctl_app *app)
+{
+    g_clear_object(&app->device);
+    g_clear_pointer(&app->device_path, g_free);
+    g_clear_pointer(&app->archive_writer, gridctl_archive_writer_free);
+    g_clear_pointer(&app->record_writer, gridctl_record_writer_free);
+
+#ifdef G_OS_UNIX
+    g_clear_pointer(&app->shm_writer, gridctl_shm_writer_free);
+#endif
+
+    g_clear_pointer(&app->loop, g_main_loop_unref);
 }
 
 int
-main(void)
+main(int argc, char *argv[])
 {
-    g_autofree gchar *device_path = find_grid_device();
-    if (!device_path) {
-        g_warning("Can't find NZXT Grid device");
+    g_autoptr(GOptionContext) context = g_option_context_new(NULL);
+    g_autoptr(GError) err = NULL;
+
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("%s\n", err->message);
         return EXIT_FAILURE;
     }
 
-    g_autoptr(GInputStream) input_stream = open_device(device_path);
-    if (!input_stream) {
-        g_warning("Can't open device");
+    /* The clock takes an unsigned interval, a negative one would wait for weeks */
+    if (snapshot_timeout <= 0) {
+        g_printerr("--timeout must be a positive number of milliseconds\n");
         return EXIT_FAILURE;
     }
 
-    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
-    schedule_read(input_stream);
-    g_main_loop_run(loop);
+    struct gridctl_app app = {
+        .clock = gridctl_clock_get_default(),
+        .exit_status = EXIT_FAILURE,
+    };
+
+#ifdef G_OS_UNIX
+    if (device_fd >= 0) {
+        g_autoptr(GInputStream) stream = g_unix_input_stream_new(device_fd, TRUE);
+        app.device = gridctl_device_new(stream);
+    }
+#endif
+
+    if (!app.device) {
+        app.device_path = device_path_override ? g_strdup(device_path_override)
+                                               : gridctl_hid_find_grid_device();
+        if (!app.device_path) {
+            g_warning("Can't find NZXT Grid device");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Nothing else to do while the device opens, so skip the worker thread */
+    if (!app.device && snapshot) {
+        g_autoptr(GInputStream) stream = gridctl_hid_open(app.device_path, &err);
+        if (!stream) {
+            g_warning("Can't open device: %s", err->message);
+            app_clear(&app);
+            return EXIT_FAILURE;
+        }
+
+        app.device = gridctl_device_new(stream);
+    }
+
+    app.loop = g_main_loop_new(NULL, FALSE);
+
+#ifdef G_OS_UNIX
+    if (shm_name) {
+        app.shm_writer = gridctl_shm_writer_new(shm_name, &err);
+        if (!app.shm_writer) {
+            g_warning("Can't create shared memory segment: %s", err->message);
+            app_clear(&app);
+            return EXIT_FAILURE;
+        }
+    }
+
+    g_unix_signal_add(SIGINT, quit_signal_cb, &app);
+    g_unix_signal_add(SIGTERM, quit_signal_cb, &app);
+#endif
+
+#ifdef __linux__
+    /* Let the kernel batch our poll() timeouts with other wakeups - 10% of the interval is fine */
+    if (sample_interval > 0
+        && prctl(PR_SET_TIMERSLACK, (unsigned long)sample_interval * 100000UL) < 0)
+    {
+        g_warning("prctl(PR_SET_TIMERSLACK): %s", g_strerror(errno));
+    }
+#endif
+
+    if (stats_interval > 0) {
+        gridctl_clock_add_timeout_seconds(app.clock, stats_interval, stats_cb, &app);
+    }
+
+    if (energy_state_path) {
+        gridctl_energy_meter_init(&app.energy);
+
+        if (!gridctl_energy_meter_load(&app.energy, energy_state_path, &err)) {
+            if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+                g_warning("Can't load energy totals, starting from zero: %s", err->message);
+            }
+            gridctl_energy_meter_init(&app.energy);
+            g_clear_error(&err);
+        }
+
+        /* Reports in a sampling wakeup share its time, so a channel's are a whole interval apart */
+        if (sample_interval > 0) {
+            gridctl_energy_meter_set_max_gap(
+                &app.energy,
+                MAX(GRIDCTL_ENERGY_MAX_GAP, 2 * (gint64)sample_interval * G_USEC_PER_SEC / 1000));
+        }
+
+        if (energy_checkpoint_interval > 0) {
+            gridctl_clock_add_timeout_seconds(
+                app.clock, energy_checkpoint_interval, energy_checkpoint_cb, &app);
+        }
+    }
+
+    if (output_format) {
+        app.record_writer = record_writer_new(app.clock, &err);
+        if (!app.record_writer) {
+            g_warning("Can't open output: %s", err->message);
+            app_clear(&app);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (archive_path) {
+        app.archive_writer = gridctl_archive_writer_new(archive_path, &err);
+        if (!app.archive_writer) {
+            g_warning("Can't open archive: %s", err->message);
+            app_clear(&app);
+            return EXIT_FAILURE;
+        }
+
+        gridctl_clock_add_timeout_seconds(
+            app.clock, ARCHIVE_FLUSH_INTERVAL, archive_flush_cb, &app);
+    }
+
+    if (app.device) {
+        start_device(&app);
+    } else {
+        gridctl_device_open_async(app.device_path, NULL, open_cb, &app);
+    }
+
+    g_main_loop_run(app.loop);
+
+    if (energy_state_path) {
+        save_energy(&app);
+    }
+
+    if (app.archive_writer) {
+        flush_archive(&app);
+    }
+
+    if (app.record_writer) {
+        flush_records(&app);
+    }
+
+    app_clear(&app);
 
-    return EXIT_SUCCESS;
+    return app.exit_status;
 }
@@ -7,6 +7,9 @@ static const guint16 USB_PRODUCT_ID_NZXT_GRID_V3 = 0x1711;
 
 static const guint8 NZXT_GRID_STATUS_REPORT_ID = 4;
 
+/* Channel index is a 4-bit field, but Grid v3 only has 6 fan headers */
+#define NZXT_GRID_V3_CHANNEL_COUNT 6
+
 struct nzxt_grid_status_report {
     guint8 report_id;
     guint8 unknown1[2];
@@ -23,6 +26,12 @@ struct nzxt_grid_status_report {
     guint8 unknown4[5]; /* NOLINT(readability-magic-numbers) */
 } __attribute__((packed));
 
+static inline gboolean
+nzxt_grid_status_report_is_valid(const guint8 *data, gsize size)
+{
+    return size == sizeof(struct nzxt_grid_status_report) && data[0] == NZXT_GRID_STATUS_REPORT_ID;
+}
+
 static inline guint8
 nzxt_grid_status_report_get_fan_type(const struct nzxt_grid_status_report *report)
 {
@@ -40,3 +49,15 @@ nzxt_grid_status_report_get_rpm(const struct nzxt_grid_status_report *report)
 {
     return GUINT16_FROM_BE(report->rpm);
 }
+
+static inline guint32
+nzxt_grid_status_report_get_voltage_mv(const struct nzxt_grid_status_report *report)
+{
+    return report->in_volt * 1000U + report->in_centivolt * 10U;
+}
+
+static inline guint32
+nzxt_grid_status_report_get_current_ma(const struct nzxt_grid_status_report *report)
+{
+    return report->curr_amp * 1000U + report->curr_centiamp * 10U;
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "archive.h"
+#include "usbmon.h"
+
+static gint bus = 0;
+static gint address = 0;
+static gboolean strict = FALSE;
+static gchar *archive_path = NULL;
+static gboolean quiet = FALSE;
+
+static const GOptionEntry option_entries[] = {
+    { "bus", 'b', 0, G_OPTION_ARG_INT, &bus, "Only look at USB bus N", "N" },
+    { "address", 'a', 0, G_OPTION_ARG_INT, &address, "Only look at device address N", "N" },
+    { "strict",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &strict,
+      "Skip devices whose descriptor isn't in the capture instead of guessing from their reports",
+      NULL },
+    { "archive",
+      0,
+      0,
+      G_OPTION_ARG_FILENAME,
+      &archive_path,
+      "Append reports to the history archive PATH instead of printing them",
+      "PATH" },
+    { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "Only print the summary", NULL },
+    { NULL },
+};
+
+struct import {
+    GridctlArchiveWriter *archive_writer;
+    GError *error;
+};
+
+static gboolean
+report_cb(const struct gridctl_usbmon_report *report, gpointer user_data)
+{
+    struct import *import = user_data;
+
+    if (import->archive_writer) {
+        return gridctl_archive_writer_append_report(
+            import->archive_writer, report->report, report->time, &import->error);
+    }
+
+    if (!quiet) {
+        printf("%" G_GINT64_FORMAT ",%u,%u,%u,%u,%u,%u,%u\n",
+               report->time,
+               report->bus,
+               report->address,
+               nzxt_grid_status_report_get_channel(report->report),
+               nzxt_grid_status_report_get_fan_type(report->report),
+               nzxt_grid_status_report_get_rpm(report->report),
+               nzxt_grid_status_report_get_voltage_mv(report->report),
+               nzxt_grid_status_report_get_current_ma(report->report));
+    }
+
+    return TRUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new("FILE");
+    g_autoptr(GError) error = NULL;
+
+    g_option_context_set_summary(
+        context,
+        "Extract NZXT Grid status reports from a usbmon pcap/pcapng capture and print them as CSV "
+        "(time_us,bus,address,channel,fan_type,rpm,voltage_mv,current_ma)");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (argc != 2) {
+        g_printerr("Expected exactly one FILE\n");
+        return EXIT_FAILURE;
+    }
+
+    struct gridctl_usbmon_filter filter = {
+        .bus = (guint16)CLAMP(bus, 0, G_MAXUINT16),
+        .address = (guint8)CLAMP(address, 0, 127),
+        .strict = strict,
+    };
+    struct import import = { 0 };
+
+    if (archive_path) {
+        import.archive_writer = gridctl_archive_writer_new(archive_path, &error);
+        if (!import.archive_writer) {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct gridctl_usbmon_stats stats = { 0 };
+    gint64 start = g_get_monotonic_time();
+    gboolean ok = gridctl_usbmon_import(argv[1], &filter, report_cb, &import, &stats, &error);
+    gint64 elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    fflush(stdout);
+
+    if (import.archive_writer) {
+        if (!import.error) {
+            gridctl_archive_writer_flush(import.archive_writer, &import.error);
+        }
+        gridctl_archive_writer_free(import.archive_writer);
+    }
+
+    g_printerr("%" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT
+               " interrupt IN transfers, %" G_GUINT64_FORMAT " reports, %" G_GUINT64_FORMAT
+               " invalid, %" G_GUINT64_FORMAT " skipped (%.1f MB/s)\n",
+               stats.n_packets,
+               stats.n_transfers,
+               stats.n_reports,
+               stats.n_invalid,
+               stats.n_skipped,
+               (double)stats.n_bytes / elapsed);
+
+    if (import.error) {
+        g_printerr("%s\n", import.error->message);
+        g_error_free(import.error);
+        return EXIT_FAILURE;
+    }
+
+    if (!ok) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
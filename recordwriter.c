@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "recordwriter.h"
+
+#define BUFFER_SIZE (64 * 1024)
+
+/* Longest NDJSON record, with every number at its widest */
+#define RECORD_MAX_SIZE 160
+
+static const gchar CSV_HEADER[] = "time_us,channel,rpm,voltage_mv,current_ma,fan_type\n";
+
+struct _GridctlRecordWriter {
+    GOutputStream *stream;
+    GridctlClock *clock;
+    GridctlRecordFormat format;
+    guint max_latency_ms;
+    guint flush_source_id;
+
+    guint64 n_records;
+    guint64 n_writes;
+
+    gsize length;
+    gchar buffer[BUFFER_SIZE];
+};
+
+static const gchar digit_pairs[] = "00010203040506070809"
+                                   "10111213141516171819"
+                                   "20212223242526272829"
+                                   "30313233343536373839"
+                                   "40414243444546474849"
+                                   "50515253545556575859"
+                                   "60616263646566676869"
+                                   "70717273747576777879"
+                                   "80818283848586878889"
+                                   "90919293949596979899";
+
+/* printf() is most of the cost of a record otherwise - two digits at a time, no locale */
+static inline gchar *
+put_uint(gchar *p, guint64 value)
+{
+    gchar digits[20];
+    gchar *end = digits + sizeof(digits);
+    gchar *q = end;
+
+    while (value >= 100) {
+        q -= 2;
+        memcpy(q, &digit_pairs[(value % 100) * 2], 2);
+        value /= 100;
+    }
+
+    if (value >= 10) {
+        q -= 2;
+        memcpy(q, &digit_pairs[value * 2], 2);
+    } else {
+        *--q = (gchar)('0' + value);
+    }
+
+    memcpy(p, q, (gsize)(end - q));
+    return p + (end - q);
+}
+
+static inline gchar *
+put_int(gchar *p, gint64 value)
+{
+    if (value < 0) {
+        *p++ = '-';
+        return put_uint(p, -(guint64)value);
+    }
+
+    return put_uint(p, (guint64)value);
+}
+
+#define put_literal(p, s) (memcpy((p), (s), sizeof(s) - 1), (p) + sizeof(s) - 1)
+
+/* Appending to a file that already has rows must not add another header in the middle of it */
+static gboolean
+stream_is_empty(GOutputStream *stream)
+{
+    if (!G_IS_FILE_OUTPUT_STREAM(stream)) {
+        return TRUE;
+    }
+
+    g_autoptr(GFileInfo) info = g_file_output_stream_query_info(
+        G_FILE_OUTPUT_STREAM(stream), G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+
+    return !info || g_file_info_get_size(info) == 0;
+}
+
+static gchar *
+format_ndjson(gchar *p, const struct nzxt_grid_status_report *report, gint64 real_time)
+{
+    p = put_literal(p, "{\"time_us\":");
+    p = put_int(p, real_time);
+    p = put_literal(p, ",\"channel\":");
+    p = put_uint(p, nzxt_grid_status_report_get_channel(report));
+    p = put_literal(p, ",\"rpm\":");
+    p = put_uint(p, nzxt_grid_status_report_get_rpm(report));
+    p = put_literal(p, ",\"voltage_mv\":");
+    p = put_uint(p, nzxt_grid_status_report_get_voltage_mv(report));
+    p = put_literal(p, ",\"current_ma\":");
+    p = put_uint(p, nzxt_grid_status_report_get_current_ma(report));
+    p = put_literal(p, ",\"fan_type\":");
+    p = put_uint(p, nzxt_grid_status_report_get_fan_type(report));
+    return put_literal(p, "}\n");
+}
+
+static gchar *
+format_csv(gchar *p, const struct nzxt_grid_status_report *report, gint64 real_time)
+{
+    p = put_int(p, real_time);
+    *p++ = ',';
+    p = put_uint(p, nzxt_grid_status_report_get_channel(report));
+    *p++ = ',';
+    p = put_uint(p, nzxt_grid_status_report_get_rpm(report));
+    *p++ = ',';
+    p = put_uint(p, nzxt_grid_status_report_get_voltage_mv(report));
+    *p++ = ',';
+    p = put_uint(p, nzxt_grid_status_report_get_current_ma(report));
+    *p++ = ',';
+    p = put_uint(p, nzxt_grid_status_report_get_fan_type(report));
+    *p++ = '\n';
+    return p;
+}
+
+GridctlRecordWriter *
+gridctl_record_writer_new(GOutputStream *stream,
+                          GridctlClock *clock,
+                          GridctlRecordFormat format,
+                          guint max_latency_ms)
+{
+    g_return_val_if_fail(G_IS_OUTPUT_STREAM(stream), NULL);
+    g_return_val_if_fail(GRIDCTL_IS_CLOCK(clock), NULL);
+
+    GridctlRecordWriter *writer = g_new0(GridctlRecordWriter, 1);
+    writer->stream = g_object_ref(stream);
+    writer->clock = g_object_ref(clock);
+    writer->format = format;
+    writer->max_latency_ms = max_latency_ms;
+
+    if (format == GRIDCTL_RECORD_FORMAT_CSV && stream_is_empty(stream)) {
+        memcpy(writer->buffer, CSV_HEADER, sizeof(CSV_HEADER) - 1);
+        writer->length = sizeof(CSV_HEADER) - 1;
+    }
+
+    return writer;
+}
+
+/* Buffered records are dropped on error, there's no point in retrying them before newer ones */
+gboolean
+gridctl_record_writer_flush(GridctlRecordWriter *writer, GError **error)
+{
+    if (writer->flush_source_id) {
+        gridctl_clock_remove_timeout(writer->clock, writer->flush_source_id);
+        writer->flush_source_id = 0;
+    }
+
+    if (writer->length == 0) {
+        return TRUE;
+    }
+
+    gsize length = writer->length;
+    writer->length = 0;
+    writer->n_writes++;
+
+    return g_output_stream_write_all(writer->stream, writer->buffer, length, NULL, NULL, error);
+}
+
+static gboolean
+flush_timeout_cb(gpointer user_data)
+{
+    GridctlRecordWriter *writer = user_data;
+    g_autoptr(GError) error = NULL;
+
+    writer->flush_source_id = 0;
+
+    if (!gridctl_record_writer_flush(writer, &error)) {
+        g_warning("Can't write records: %s", error->message);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+gboolean
+gridctl_record_writer_write_report(GridctlRecordWriter *writer,
+                                   const struct nzxt_grid_status_report *report,
+                                   gint64 real_time,
+                                   GError **error)
+{
+    if (writer->length + RECORD_MAX_SIZE > sizeof(writer->buffer)
+        && !gridctl_record_writer_flush(writer, error))
+    {
+        return FALSE;
+    }
+
+    gchar *start = writer->buffer + writer->length;
+    gchar *end = writer->format == GRIDCTL_RECORD_FORMAT_CSV
+                     ? format_csv(start, report, real_time)
+                     : format_ndjson(start, report, real_time);
+
+    writer->length += (gsize)(end - start);
+    writer->n_records++;
+
+    if (writer->max_latency_ms == 0) {
+        return gridctl_record_writer_flush(writer, error);
+    }
+
+    if (!writer->flush_source_id) {
+        writer->flush_source_id = gridctl_clock_add_timeout(
+            writer->clock, writer->max_latency_ms, flush_timeout_cb, writer);
+    }
+
+    return TRUE;
+}
+
+guint64
+gridctl_record_writer_get_record_count(GridctlRecordWriter *writer)
+{
+    return writer->n_records;
+}
+
+/* Number of writes to the stream - records per write is the batching factor */
+guint64
+gridctl_record_writer_get_write_count(GridctlRecordWriter *writer)
+{
+    return writer->n_writes;
+}
+
+/* Buffered records are lost unless gridctl_record_writer_flush() was called first */
+void
+gridctl_record_writer_free(GridctlRecordWriter *writer)
+{
+    if (writer->flush_source_id) {
+        gridctl_clock_remove_timeout(writer->clock, writer->flush_source_id);
+    }
+
+    g_object_unref(writer->stream);
+    g_object_unref(writer->clock);
+    g_free(writer);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "clock.h"
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Structured output of status reports, one NDJSON object or CSV row per report:
+ * time_us, channel, rpm, voltage_mv, current_ma, fan_type.
+ *
+ * Records are formatted into a fixed buffer and written out in batches: when the buffer is full,
+ * or at most max_latency_ms after the oldest buffered record was added (0 writes every record
+ * right away). Writing a record doesn't allocate.
+ *
+ * CSV output starts with a header row, unless the stream is a GFileOutputStream on a file that
+ * already has data in it, such as one reopened with g_file_append_to().
+ */
+
+typedef enum {
+    GRIDCTL_RECORD_FORMAT_NDJSON,
+    GRIDCTL_RECORD_FORMAT_CSV,
+} GridctlRecordFormat;
+
+typedef struct _GridctlRecordWriter GridctlRecordWriter;
+
+GridctlRecordWriter *
+gridctl_record_writer_new(GOutputStream *stream,
+                          GridctlClock *clock,
+                          GridctlRecordFormat format,
+                          guint max_latency_ms);
+
+gboolean
+gridctl_record_writer_write_report(GridctlRecordWriter *writer,
+                                   const struct nzxt_grid_status_report *report,
+                                   gint64 real_time,
+                                   GError **error);
+
+gboolean
+gridctl_record_writer_flush(GridctlRecordWriter *writer, GError **error);
+
+guint64
+gridctl_record_writer_get_record_count(GridctlRecordWriter *writer);
+
+guint64
+gridctl_record_writer_get_write_count(GridctlRecordWriter *writer);
+
+void
+gridctl_record_writer_free(GridctlRecordWriter *writer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GridctlRecordWriter, gridctl_record_writer_free)
+
+G_END_DECLS
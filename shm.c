@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm.h"
+#include "util.h"
+
+struct _GridctlShmWriter {
+    gchar *name;
+    struct gridctl_shm_segment *segment;
+
+    /* Private copy of the published state, so the writer never reads the shared mapping */
+    struct gridctl_shm_sample samples[NZXT_GRID_V3_CHANNEL_COUNT];
+};
+
+/* A writer that crashed leaves its segment behind, only one whose writer still runs is taken */
+static gboolean
+check_segment_unused(int fd, const gchar *name, GError **error)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        gridctl_set_error_from_errno(error, "fstat", name);
+        return FALSE;
+    }
+
+    if (st.st_size < (off_t)sizeof(struct gridctl_shm_header)) {
+        return TRUE;
+    }
+
+    struct gridctl_shm_header *header
+        = mmap(NULL, sizeof(struct gridctl_shm_header), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        gridctl_set_error_from_errno(error, "mmap", name);
+        return FALSE;
+    }
+
+    gboolean live = atomic_load_explicit(&header->magic, memory_order_acquire) == GRIDCTL_SHM_MAGIC;
+    pid_t pid = (pid_t)header->writer_pid;
+    munmap(header, sizeof(struct gridctl_shm_header));
+
+    if (live && pid > 0 && (kill(pid, 0) == 0 || errno == EPERM)) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_EXIST,
+                    "%s: segment is in use by process %d",
+                    name,
+                    (int)pid);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+GridctlShmWriter *
+gridctl_shm_writer_new(const gchar *name, GError **error)
+{
+    int fd = shm_open(
+        name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if (fd < 0 && errno == EEXIST) {
+        fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+
+        if (fd >= 0 && !check_segment_unused(fd, name, error)) {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    if (fd < 0) {
+        gridctl_set_error_from_errno(error, "shm_open", name);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(struct gridctl_shm_segment)) < 0) {
+        gridctl_set_error_from_errno(error, "ftruncate", name);
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL,
+                         sizeof(struct gridctl_shm_segment),
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         fd,
+                         0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        gridctl_set_error_from_errno(error, "mmap", name);
+        return NULL;
+    }
+
+    GridctlShmWriter *writer = g_new0(GridctlShmWriter, 1);
+    writer->name = g_strdup(name);
+    writer->segment = mapping;
+
+    /* The segment may be left over from a writer that crashed - readers must not see it live */
+    struct gridctl_shm_header *header = &writer->segment->header;
+    atomic_store_explicit(&header->magic, 0, memory_order_relaxed);
+    memset(writer->segment->channels, 0, sizeof(writer->segment->channels));
+
+    header->version = GRIDCTL_SHM_VERSION;
+    header->size = sizeof(struct gridctl_shm_segment);
+    header->n_channels = NZXT_GRID_V3_CHANNEL_COUNT;
+    header->writer_pid = getpid();
+    atomic_store_explicit(&header->magic, GRIDCTL_SHM_MAGIC, memory_order_release);
+
+    return writer;
+}
+
+void
+gridctl_shm_writer_publish(GridctlShmWriter *writer,
+                           const struct nzxt_grid_status_report *report,
+                           gint64 time)
+{
+    guint8 channel = nzxt_grid_status_report_get_channel(report);
+    if (channel >= NZXT_GRID_V3_CHANNEL_COUNT) {
+        return;
+    }
+
+    struct gridctl_shm_sample *sample = &writer->samples[channel];
+    sample->n_reports++;
+    sample->time = time;
+    sample->fan_type = nzxt_grid_status_report_get_fan_type(report);
+    sample->rpm = nzxt_grid_status_report_get_rpm(report);
+    sample->voltage_mv = nzxt_grid_status_report_get_voltage_mv(report);
+    sample->current_ma = nzxt_grid_status_report_get_current_ma(report);
+
+    guint64 words[GRIDCTL_SHM_SAMPLE_WORDS];
+    memcpy(words, sample, sizeof(words));
+
+    struct gridctl_shm_channel *slot = &writer->segment->channels[channel];
+    guint64 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (gsize i = 0; i < GRIDCTL_SHM_SAMPLE_WORDS; i++) {
+        atomic_store_explicit(&slot->sample[i], words[i], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void
+gridctl_shm_writer_free(GridctlShmWriter *writer)
+{
+    if (!writer) {
+        return;
+    }
+
+    atomic_store_explicit(&writer->segment->header.magic, 0, memory_order_release);
+    munmap(writer->segment, sizeof(struct gridctl_shm_segment));
+
+    if (shm_unlink(writer->name) < 0) {
+        g_warning("shm_unlink(%s): %s", writer->name, g_strerror(errno));
+    }
+
+    g_free(writer->name);
+    g_free(writer);
+}
+
+const struct gridctl_shm_segment *
+gridctl_shm_map(const gchar *name, GError **error)
+{
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        gridctl_set_error_from_errno(error, "shm_open", name);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        gridctl_set_error_from_errno(error, "fstat", name);
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size < (off_t)sizeof(struct gridctl_shm_segment)) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_INVAL,
+                    "%s: segment is too small (%jd bytes)",
+                    name,
+                    (intmax_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, sizeof(struct gridctl_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        gridctl_set_error_from_errno(error, "mmap", name);
+        return NULL;
+    }
+
+    const struct gridctl_shm_segment *segment = mapping;
+    if (!gridctl_shm_is_live(segment) || segment->header.version != GRIDCTL_SHM_VERSION
+        || segment->header.size != sizeof(struct gridctl_shm_segment)
+        || segment->header.n_channels > NZXT_GRID_V3_CHANNEL_COUNT)
+    {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_INVAL,
+                    "%s: no live segment with layout version %u",
+                    name,
+                    GRIDCTL_SHM_VERSION);
+        gridctl_shm_unmap(segment);
+        return NULL;
+    }
+
+    return segment;
+}
+
+void
+gridctl_shm_unmap(const struct gridctl_shm_segment *segment)
+{
+    munmap((void *)segment, sizeof(struct gridctl_shm_segment));
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Shared memory segment with the latest state of every channel, published by gridctl --shm.
+ *
+ * The layout is fixed and versioned: readers must check the header with gridctl_shm_is_live()
+ * before trusting anything else. Every channel lives in its own cache line and is protected by a
+ * seqlock, so readers never block the writer and never need a syscall to take a snapshot.
+ */
+
+#define GRIDCTL_SHM_DEFAULT_NAME "/gridctl"
+
+#define GRIDCTL_SHM_MAGIC 0x4c544347U /* "GCTL" */
+#define GRIDCTL_SHM_VERSION 1U
+
+/* Give up on a channel the writer keeps updating (or died updating) after this many attempts */
+#define GRIDCTL_SHM_READ_ATTEMPTS 1000
+
+struct gridctl_shm_sample {
+    guint64 n_reports; /* 0 if the channel hasn't reported yet */
+    gint64 time; /* g_get_monotonic_time() when the last report was received */
+    guint64 fan_type;
+    guint64 rpm;
+    guint64 voltage_mv;
+    guint64 current_ma;
+};
+
+#define GRIDCTL_SHM_SAMPLE_WORDS (sizeof(struct gridctl_shm_sample) / sizeof(guint64))
+
+struct gridctl_shm_channel {
+    _Atomic guint64 seq; /* odd while the writer is updating the sample */
+    _Atomic guint64 sample[GRIDCTL_SHM_SAMPLE_WORDS];
+} __attribute__((aligned(64)));
+
+struct gridctl_shm_header {
+    _Atomic guint32 magic; /* stored last on creation, cleared before the writer exits */
+    guint32 version;
+    guint32 size;
+    guint32 n_channels;
+    gint64 writer_pid;
+} __attribute__((aligned(64)));
+
+struct gridctl_shm_segment {
+    struct gridctl_shm_header header;
+    struct gridctl_shm_channel channels[NZXT_GRID_V3_CHANNEL_COUNT];
+};
+
+typedef struct _GridctlShmWriter GridctlShmWriter;
+
+/* Fails with G_FILE_ERROR_EXIST while another running process publishes to the same name */
+GridctlShmWriter *
+gridctl_shm_writer_new(const gchar *name, GError **error);
+
+void
+gridctl_shm_writer_publish(GridctlShmWriter *writer,
+                           const struct nzxt_grid_status_report *report,
+                           gint64 time);
+
+void
+gridctl_shm_writer_free(GridctlShmWriter *writer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GridctlShmWriter, gridctl_shm_writer_free)
+
+const struct gridctl_shm_segment *
+gridctl_shm_map(const gchar *name, GError **error);
+
+void
+gridctl_shm_unmap(const struct gridctl_shm_segment *segment);
+
+/* FALSE once the writer has exited - the segment should be unmapped and mapped again */
+static inline gboolean
+gridctl_shm_is_live(const struct gridctl_shm_segment *segment)
+{
+    return atomic_load_explicit(&segment->header.magic, memory_order_acquire) == GRIDCTL_SHM_MAGIC;
+}
+
+/*
+ * Copy a consistent snapshot of one channel. Returns FALSE if the channel hasn't reported yet, or
+ * if no consistent snapshot could be taken within GRIDCTL_SHM_READ_ATTEMPTS.
+ */
+static inline gboolean
+gridctl_shm_read_sample(const struct gridctl_shm_segment *segment,
+                        guint channel,
+                        struct gridctl_shm_sample *sample)
+{
+    g_return_val_if_fail(channel < segment->header.n_channels, FALSE);
+
+    const struct gridctl_shm_channel *slot = &segment->channels[channel];
+    guint64 words[GRIDCTL_SHM_SAMPLE_WORDS];
+
+    for (int attempt = 0; attempt < GRIDCTL_SHM_READ_ATTEMPTS; attempt++) {
+        guint64 begin = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (begin & 1) {
+            continue;
+        }
+
+        for (gsize i = 0; i < GRIDCTL_SHM_SAMPLE_WORDS; i++) {
+            words[i] = atomic_load_explicit(&slot->sample[i], memory_order_relaxed);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == begin) {
+            memcpy(sample, words, sizeof(words));
+            return sample->n_reports != 0;
+        }
+    }
+
+    return FALSE;
+}
+
+G_END_DECLS
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "shm.h"
+
+static gchar *shm_name = NULL;
+static gint watch_interval_ms = 0;
+
+static const GOptionEntry option_entries[] = {
+    { "name", 'n', 0, G_OPTION_ARG_STRING, &shm_name, "Shared memory segment name", "NAME" },
+    { "watch", 'w', 0, G_OPTION_ARG_INT, &watch_interval_ms, "Repeat every MS milliseconds", "MS" },
+    { NULL },
+};
+
+static void
+print_segment(const struct gridctl_shm_segment *segment)
+{
+    gint64 now = g_get_monotonic_time();
+
+    for (guint channel = 0; channel < segment->header.n_channels; channel++) {
+        struct gridctl_shm_sample sample;
+
+        if (!gridctl_shm_read_sample(segment, channel, &sample)) {
+            printf("channel %u: no data\n", channel);
+            continue;
+        }
+
+        printf("channel %u: fan_type=%" G_GUINT64_FORMAT " rpm=%" G_GUINT64_FORMAT
+               " voltage=%" G_GUINT64_FORMAT "mV current=%" G_GUINT64_FORMAT
+               "mA reports=%" G_GUINT64_FORMAT " age=%.3fs\n",
+               channel,
+               sample.fan_type,
+               sample.rpm,
+               sample.voltage_mv,
+               sample.current_ma,
+               sample.n_reports,
+               (double)(now - sample.time) / G_USEC_PER_SEC);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new(NULL);
+    g_autoptr(GError) error = NULL;
+
+    g_option_context_set_summary(context, "Print channel state published by gridctl --shm");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    const gchar *name = shm_name ? shm_name : GRIDCTL_SHM_DEFAULT_NAME;
+    const struct gridctl_shm_segment *segment = gridctl_shm_map(name, &error);
+    if (!segment) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    for (;;) {
+        if (!gridctl_shm_is_live(segment)) {
+            g_printerr("%s: writer has exited\n", name);
+            gridctl_shm_unmap(segment);
+            return EXIT_FAILURE;
+        }
+
+        print_segment(segment);
+
+        if (watch_interval_ms <= 0) {
+            break;
+        }
+
+        printf("\n");
+        fflush(stdout);
+        g_usleep((gulong)watch_interval_ms * 1000);
+    }
+
+    gridctl_shm_unmap(segment);
+    return EXIT_SUCCESS;
+}
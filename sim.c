@@ -0,0 +1,541 @@
+#define _GNU_SOURCE /* posix_openpt(), cfmakeraw() */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "nzxtgridproto.h"
+
+/* Simulates the status report stream of an NZXT Grid v3 for gridctl load and soak tests */
+
+#define SIM_DEVICE_FD 3
+
+static gint n_channels = NZXT_GRID_V3_CHANNEL_COUNT;
+static gchar *fan_types_str = NULL;
+static gdouble rate = 10.0;
+static gdouble duration = 0.0;
+static gdouble malformed_rate = 0.0;
+static gdouble short_rate = 0.0;
+static gint64 disconnect_every = 0;
+static gint disconnect_time = 500;
+static gint seed = 0;
+static gchar *fifo_path = NULL;
+static gboolean use_pty = FALSE;
+static gboolean use_socket = FALSE;
+
+static const GOptionEntry option_entries[] = {
+    { "channels", 'c', 0, G_OPTION_ARG_INT, &n_channels, "Number of channels (1-6)", "N" },
+    { "fan-types",
+      't',
+      0,
+      G_OPTION_ARG_STRING,
+      &fan_types_str,
+      "Comma-separated fan type per channel, 0 = no fan (default: 2 on every channel)",
+      "T,T,..." },
+    { "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &rate, "Reports per second, all channels", "HZ" },
+    { "duration", 'D', 0, G_OPTION_ARG_DOUBLE, &duration, "Stop after SEC seconds", "SEC" },
+    { "malformed-rate",
+      0,
+      0,
+      G_OPTION_ARG_DOUBLE,
+      &malformed_rate,
+      "Fraction of reports sent with a wrong report ID",
+      "P" },
+    { "short-rate",
+      0,
+      0,
+      G_OPTION_ARG_DOUBLE,
+      &short_rate,
+      "Fraction of reports truncated. Only the socket transport keeps report boundaries, "
+      "elsewhere this desynchronizes the stream",
+      "P" },
+    { "disconnect-every",
+      0,
+      0,
+      G_OPTION_ARG_INT64,
+      &disconnect_every,
+      "Close the transport every N reports. The FIFO is reopened, other transports exit",
+      "N" },
+    { "disconnect-time",
+      0,
+      0,
+      G_OPTION_ARG_INT,
+      &disconnect_time,
+      "How long the FIFO stays closed after a disconnect (default: 500)",
+      "MS" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Random seed (default: time based)", "SEED" },
+    { "fifo",
+      'f',
+      0,
+      G_OPTION_ARG_FILENAME,
+      &fifo_path,
+      "Write to a FIFO, created if needed",
+      "PATH" },
+    { "pty",
+      'p',
+      0,
+      G_OPTION_ARG_NONE,
+      &use_pty,
+      "Write to a pseudo-terminal, prints its path",
+      NULL },
+    { "socket",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &use_socket,
+      "Run the command after -- with one end of a SOCK_SEQPACKET socketpair as fd 3",
+      NULL },
+    { NULL },
+};
+
+struct sim_channel {
+    guint8 fan_type;
+    gdouble rpm;
+    gdouble target_rpm;
+    gint64 next_target_change;
+};
+
+struct sim {
+    GRand *rand;
+    struct sim_channel channels[NZXT_GRID_V3_CHANNEL_COUNT];
+    gint fd;
+    GPid child_pid;
+    gchar *pty_path;
+
+    guint64 n_sent;
+    guint64 n_malformed;
+    guint64 n_short;
+    guint64 n_disconnects;
+};
+
+static const gdouble RPM_MIN = 300.0;
+static const gdouble RPM_MAX = 2200.0;
+
+/* Fans spin up/down with roughly this time constant */
+static const gdouble RPM_TIME_CONSTANT_S = 2.0;
+
+static gboolean
+parse_fan_types(struct sim *sim, GError **error)
+{
+    for (gint channel = 0; channel < n_channels; channel++) {
+        sim->channels[channel].fan_type = 2;
+    }
+
+    if (!fan_types_str) {
+        return TRUE;
+    }
+
+    g_auto(GStrv) fan_types = g_strsplit(fan_types_str, ",", -1);
+    for (gint channel = 0; fan_types[channel] != NULL; channel++) {
+        guint64 fan_type;
+
+        if (channel >= n_channels) {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        "More fan types than channels");
+            return FALSE;
+        }
+
+        if (!g_ascii_string_to_unsigned(fan_types[channel], 10, 0, 3, &fan_type, error)) {
+            return FALSE;
+        }
+
+        sim->channels[channel].fan_type = fan_type;
+    }
+
+    return TRUE;
+}
+
+/* Fans are already spinning when the simulated device is plugged in */
+static void
+init_channels(struct sim *sim, gint64 now)
+{
+    for (gint channel_index = 0; channel_index < n_channels; channel_index++) {
+        struct sim_channel *channel = &sim->channels[channel_index];
+
+        if (channel->fan_type == 0) {
+            continue;
+        }
+
+        channel->target_rpm = g_rand_double_range(sim->rand, RPM_MIN, RPM_MAX);
+        channel->rpm = channel->target_rpm;
+        channel->next_target_change
+            = now + g_rand_int_range(sim->rand, 2, 30) * (gint64)G_USEC_PER_SEC;
+    }
+}
+
+static void
+update_channel(struct sim *sim, struct sim_channel *channel, gint64 now, gdouble dt)
+{
+    if (channel->fan_type == 0) {
+        channel->rpm = 0;
+        return;
+    }
+
+    if (now >= channel->next_target_change) {
+        channel->target_rpm = g_rand_double_range(sim->rand, RPM_MIN, RPM_MAX);
+        channel->next_target_change
+            = now + g_rand_int_range(sim->rand, 2, 30) * (gint64)G_USEC_PER_SEC;
+    }
+
+    /* First-order lag towards the target plus ~1% tachometer jitter */
+    channel->rpm += (channel->target_rpm - channel->rpm) * (1.0 - exp(-dt / RPM_TIME_CONSTANT_S));
+    channel->rpm *= 1.0 + g_rand_double_range(sim->rand, -0.01, 0.01);
+}
+
+static void
+fill_report(struct sim *sim,
+            guint channel_index,
+            struct nzxt_grid_status_report *report)
+{
+    const struct sim_channel *channel = &sim->channels[channel_index];
+    guint16 rpm = (guint16)CLAMP(channel->rpm, 0, G_MAXUINT16);
+
+    /* 12V rail with a small sag, fan current roughly cubic in speed */
+    guint voltage_cv = 1200 - g_rand_int_range(sim->rand, 0, 8);
+    guint current_ca = 0;
+    if (channel->fan_type != 0) {
+        gdouble load = channel->rpm / RPM_MAX;
+        current_ca = 3 + (guint)(25 * load * load * load);
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->report_id = NZXT_GRID_STATUS_REPORT_ID;
+    report->rpm = GUINT16_TO_BE(rpm);
+    report->in_volt = voltage_cv / 100;
+    report->in_centivolt = voltage_cv % 100;
+    report->curr_amp = current_ca / 100;
+    report->curr_centiamp = current_ca % 100;
+    report->firmware_version_major = 1;
+    report->firmware_version_minor = GUINT16_TO_BE(3);
+    report->firmware_version_patch = 0;
+    report->channel_index_and_fan_type = (channel_index << 4) | (channel->fan_type & 0x3);
+}
+
+static gboolean
+open_fifo(struct sim *sim, GError **error)
+{
+    if (mkfifo(fifo_path, S_IRUSR | S_IWUSR) < 0 && errno != EEXIST) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errsv),
+                    "mkfifo(%s): %s",
+                    fifo_path,
+                    g_strerror(errsv));
+        return FALSE;
+    }
+
+    /* Blocks until gridctl opens the other end */
+    sim->fd = open(fifo_path, O_WRONLY | O_CLOEXEC);
+    if (sim->fd < 0) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errsv),
+                    "open(%s): %s",
+                    fifo_path,
+                    g_strerror(errsv));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+open_pty(struct sim *sim, GError **error)
+{
+    sim->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (sim->fd < 0 || grantpt(sim->fd) < 0 || unlockpt(sim->fd) < 0) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errsv),
+                    "Can't allocate a pseudo-terminal: %s",
+                    g_strerror(errsv));
+        return FALSE;
+    }
+
+    sim->pty_path = g_strdup(ptsname(sim->fd));
+
+    /* Reports are binary - no line discipline processing */
+    struct termios tio;
+    if (tcgetattr(sim->fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(sim->fd, TCSANOW, &tio);
+    }
+
+    printf("%s\n", sim->pty_path);
+    fflush(stdout);
+    return TRUE;
+}
+
+static gboolean
+spawn_with_socket(struct sim *sim, gchar **argv, GError **error)
+{
+    int fds[2];
+
+    if (!argv || !argv[0]) {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "--socket needs a command after --");
+        return FALSE;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errsv),
+                    "socketpair: %s",
+                    g_strerror(errsv));
+        return FALSE;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errsv),
+                    "fork: %s",
+                    g_strerror(errsv));
+        close(fds[0]);
+        close(fds[1]);
+        return FALSE;
+    }
+
+    if (pid == 0) {
+        /* dup2() clears FD_CLOEXEC on the copy, but does nothing if the fd is already in place */
+        int result = fds[1] == SIM_DEVICE_FD ? fcntl(SIM_DEVICE_FD, F_SETFD, 0)
+                                             : dup2(fds[1], SIM_DEVICE_FD);
+        if (result < 0) {
+            _exit(127);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    sim->fd = fds[0];
+    sim->child_pid = pid;
+    return TRUE;
+}
+
+static gboolean
+reopen(struct sim *sim)
+{
+    sim->n_disconnects++;
+    close(sim->fd);
+    sim->fd = -1;
+
+    if (!fifo_path) {
+        return FALSE;
+    }
+
+    /*
+     * The reader only sees end of file once the FIFO has no writer and is drained. Reopening
+     * right away would make the new writer overlap with the reader's old descriptor.
+     */
+    g_usleep((gulong)disconnect_time * 1000);
+
+    g_autoptr(GError) error = NULL;
+    if (!open_fifo(sim, &error)) {
+        g_printerr("%s\n", error->message);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+send_report(struct sim *sim, guint channel)
+{
+    struct nzxt_grid_status_report report;
+    gsize size = sizeof(report);
+
+    fill_report(sim, channel, &report);
+
+    if (malformed_rate > 0 && g_rand_double(sim->rand) < malformed_rate) {
+        report.report_id = NZXT_GRID_STATUS_REPORT_ID + 1;
+        sim->n_malformed++;
+    }
+
+    if (short_rate > 0 && g_rand_double(sim->rand) < short_rate) {
+        size = g_rand_int_range(sim->rand, 1, sizeof(report));
+        sim->n_short++;
+    }
+
+    for (;;) {
+        ssize_t written = write(sim->fd, &report, size);
+
+        if (written == (ssize_t)size) {
+            sim->n_sent++;
+            return TRUE;
+        }
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (written < 0 && errno != EPIPE && errno != EIO) {
+            g_printerr("write: %s\n", g_strerror(errno));
+        }
+
+        /* The reader went away */
+        return reopen(sim);
+    }
+}
+
+static void
+sleep_until(gint64 deadline)
+{
+    gint64 now = g_get_monotonic_time();
+
+    /* Above ~1 kHz batch reports instead of sleeping between every one */
+    if (deadline - now < 1000) {
+        return;
+    }
+
+    struct timespec ts = {
+        .tv_sec = deadline / G_USEC_PER_SEC,
+        .tv_nsec = (deadline % G_USEC_PER_SEC) * 1000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new("[-- COMMAND...]");
+    g_autoptr(GError) error = NULL;
+
+    g_option_context_set_summary(context,
+                                 "Emit a synthetic NZXT Grid v3 status report stream.\n"
+                                 "Without a transport option, reports are written to stdout:\n"
+                                 "  gridctl-sim | gridctl --device /dev/stdin\n"
+                                 "  gridctl-sim --socket -- gridctl --device-fd 3");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_channels < 1 || n_channels > NZXT_GRID_V3_CHANNEL_COUNT || rate <= 0) {
+        g_printerr("Invalid channel count or rate\n");
+        return EXIT_FAILURE;
+    }
+
+    if (disconnect_time < 0) {
+        g_printerr("--disconnect-time can't be negative\n");
+        return EXIT_FAILURE;
+    }
+
+    struct sim sim = {
+        .rand = g_rand_new_with_seed(seed ? (guint32)seed : (guint32)g_get_real_time()),
+        .fd = STDOUT_FILENO,
+    };
+
+    if (!parse_fan_types(&sim, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    /* Write errors tell us the reader is gone */
+    signal(SIGPIPE, SIG_IGN);
+
+    gboolean opened = TRUE;
+    if (fifo_path) {
+        opened = open_fifo(&sim, &error);
+    } else if (use_pty) {
+        opened = open_pty(&sim, &error);
+    } else if (use_socket) {
+        gchar **command = argv + 1;
+        if (command[0] && g_str_equal(command[0], "--")) {
+            command++;
+        }
+        opened = spawn_with_socket(&sim, command, &error);
+    }
+
+    if (!opened) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    gint64 period = (gint64)(G_USEC_PER_SEC / rate);
+    gint64 start = g_get_monotonic_time();
+    gint64 deadline = start;
+    gint64 end = duration > 0 ? start + (gint64)(duration * G_USEC_PER_SEC) : G_MAXINT64;
+    guint channel = 0;
+    gboolean running = TRUE;
+
+    init_channels(&sim, start);
+
+    while (running && deadline < end) {
+        sleep_until(deadline);
+
+        struct sim_channel *sim_channel = &sim.channels[channel];
+        gdouble dt = (gdouble)(period * n_channels) / G_USEC_PER_SEC;
+        update_channel(&sim, sim_channel, deadline, dt);
+        running = send_report(&sim, channel);
+
+        if (running && disconnect_every > 0 && sim.n_sent % disconnect_every == 0) {
+            running = reopen(&sim);
+            deadline = g_get_monotonic_time();
+        }
+
+        channel = (channel + 1) % n_channels;
+        deadline += period;
+
+        /* Don't try to catch up with time spent waiting for a reader to (re)connect */
+        gint64 now = g_get_monotonic_time();
+        if (now - deadline > G_USEC_PER_SEC) {
+            deadline = now;
+        }
+    }
+
+    gdouble elapsed = (gdouble)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+    g_printerr("sent %" G_GUINT64_FORMAT " reports in %.1fs (%.1f/s), %" G_GUINT64_FORMAT
+               " malformed, %" G_GUINT64_FORMAT " short, %" G_GUINT64_FORMAT " disconnects\n",
+               sim.n_sent,
+               elapsed,
+               sim.n_sent / elapsed,
+               sim.n_malformed,
+               sim.n_short,
+               sim.n_disconnects);
+
+    if (sim.fd >= 0) {
+        close(sim.fd);
+    }
+
+    int status = EXIT_SUCCESS;
+    if (sim.child_pid > 0) {
+        int child_status;
+        if (waitpid(sim.child_pid, &child_status, 0) < 0 || !WIFEXITED(child_status)
+            || WEXITSTATUS(child_status) != 0)
+        {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    g_free(sim.pty_path);
+    g_rand_free(sim.rand);
+    return status;
+}
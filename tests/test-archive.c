@@ -0,0 +1,463 @@
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "archive.h"
+
+/* 2023-11-14, in milliseconds */
+#define TEST_TIME G_GINT64_CONSTANT(1700000000000)
+
+#define MINUTE (G_GINT64_CONSTANT(60) * 1000)
+
+static gchar *tmp_dir;
+
+static gchar *
+archive_path(const gchar *name)
+{
+    g_autofree gchar *file_name = g_strconcat(name, ".gridarch", NULL);
+    return g_build_filename(tmp_dir, file_name, NULL);
+}
+
+/* Reports every ~100 ms, with jitter, the odd dropped report and values that need long varints */
+static void
+add_samples(GArray *samples, guint channel, guint8 fan_type, gint64 *time, GRand *rand, guint n)
+{
+    for (guint i = 0; i < n; i++) {
+        struct gridctl_archive_sample sample = {
+            .time = *time,
+            .channel = (guint8)channel,
+            .fan_type = fan_type,
+            .rpm = (guint16)g_rand_int_range(rand, 0, G_MAXUINT16 + 1),
+            .voltage_mv = (guint32)g_rand_int_range(rand, 11000, 13000),
+            .current_ma = i % 97 == 0 ? G_MAXUINT32 : (guint32)g_rand_int_range(rand, 0, 3000),
+        };
+
+        g_array_append_val(samples, sample);
+        *time += 100 + g_rand_int_range(rand, -5, 6) + (i % 50 == 0 ? 100 : 0);
+    }
+}
+
+static void
+write_samples(GridctlArchiveWriter *writer, GArray *samples)
+{
+    for (guint i = 0; i < samples->len; i++) {
+        g_autoptr(GError) error = NULL;
+
+        g_assert_true(gridctl_archive_writer_append(
+            writer, &g_array_index(samples, struct gridctl_archive_sample, i), &error));
+        g_assert_no_error(error);
+    }
+}
+
+static void
+write_archive(const gchar *path, GArray *samples)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GridctlArchiveWriter) writer = gridctl_archive_writer_new(path, &error);
+
+    g_assert_no_error(error);
+    write_samples(writer, samples);
+    g_assert_true(gridctl_archive_writer_flush(writer, &error));
+    g_assert_no_error(error);
+}
+
+static gboolean
+collect_cb(const struct gridctl_archive_sample *sample, gpointer user_data)
+{
+    g_array_append_vals(user_data, sample, 1);
+    return TRUE;
+}
+
+static gboolean
+sample_matches(const struct gridctl_archive_sample *sample,
+               const struct gridctl_archive_query *query)
+{
+    return (query->channel == GRIDCTL_ARCHIVE_ANY_CHANNEL || query->channel == sample->channel)
+           && sample->time >= query->time_from && sample->time <= query->time_to
+           && sample->rpm >= query->rpm_min && sample->rpm <= query->rpm_max;
+}
+
+static gint
+compare_samples(gconstpointer a, gconstpointer b)
+{
+    const struct gridctl_archive_sample *x = a;
+    const struct gridctl_archive_sample *y = b;
+
+    if (x->channel != y->channel) {
+        return x->channel < y->channel ? -1 : 1;
+    }
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    if (x->rpm != y->rpm) {
+        return x->rpm < y->rpm ? -1 : 1;
+    }
+    if (x->voltage_mv != y->voltage_mv) {
+        return x->voltage_mv < y->voltage_mv ? -1 : 1;
+    }
+    if (x->current_ma != y->current_ma) {
+        return x->current_ma < y->current_ma ? -1 : 1;
+    }
+    return (gint)x->fan_type - (gint)y->fan_type;
+}
+
+static void
+assert_samples_equal(GArray *expected, GArray *actual)
+{
+    g_assert_cmpuint(actual->len, ==, expected->len);
+
+    for (guint i = 0; i < expected->len; i++) {
+        const struct gridctl_archive_sample *x
+            = &g_array_index(expected, struct gridctl_archive_sample, i);
+        const struct gridctl_archive_sample *y
+            = &g_array_index(actual, struct gridctl_archive_sample, i);
+
+        g_assert_cmpint(y->time, ==, x->time);
+        g_assert_cmpuint(y->channel, ==, x->channel);
+        g_assert_cmpuint(y->fan_type, ==, x->fan_type);
+        g_assert_cmpuint(y->rpm, ==, x->rpm);
+        g_assert_cmpuint(y->voltage_mv, ==, x->voltage_mv);
+        g_assert_cmpuint(y->current_ma, ==, x->current_ma);
+    }
+}
+
+/*
+ * Single-channel queries return samples in the order they were written. Blocks of different
+ * channels interleave in the file, so any-channel results are compared as sets.
+ */
+static void
+assert_query(GridctlArchiveReader *reader,
+             GArray *samples,
+             const struct gridctl_archive_query *query,
+             struct gridctl_archive_stats *stats)
+{
+    g_autoptr(GArray) expected = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GArray) actual = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+
+    for (guint i = 0; i < samples->len; i++) {
+        const struct gridctl_archive_sample *sample
+            = &g_array_index(samples, struct gridctl_archive_sample, i);
+
+        if (sample_matches(sample, query)) {
+            g_array_append_vals(expected, sample, 1);
+        }
+    }
+
+    g_assert_true(gridctl_archive_reader_query(reader, query, collect_cb, actual, stats));
+
+    if (query->channel == GRIDCTL_ARCHIVE_ANY_CHANNEL) {
+        g_array_sort(expected, compare_samples);
+        g_array_sort(actual, compare_samples);
+    }
+
+    assert_samples_equal(expected, actual);
+
+    if (stats) {
+        g_assert_cmpuint(stats->n_samples, ==, expected->len);
+    }
+}
+
+static void
+assert_archive_contains(const gchar *path, GArray *samples)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    struct gridctl_archive_query query;
+    struct gridctl_archive_stats stats;
+
+    g_assert_no_error(error);
+
+    gridctl_archive_reader_get_stats(reader, &stats);
+    g_assert_cmpuint(stats.n_samples, ==, samples->len);
+
+    gridctl_archive_query_init(&query);
+    assert_query(reader, samples, &query, NULL);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        query.channel = channel;
+        assert_query(reader, samples, &query, NULL);
+    }
+}
+
+static void
+test_archive_round_trip(void)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = archive_path("round-trip");
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GRand) rand = g_rand_new_with_seed(1);
+    struct gridctl_archive_stats writer_stats;
+    struct gridctl_archive_stats reader_stats;
+
+    /* Channels take turns like the device's reports do, enough for several full blocks each */
+    for (guint round = 0; round < 20; round++) {
+        for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+            gint64 time = TEST_TIME + round * 100 * 110;
+            /* Channel 2's fan is unplugged for a while, which changes its fan type */
+            guint8 fan_type = channel == 2 && round >= 8 && round < 12 ? 0 : 2;
+
+            add_samples(samples, channel, fan_type, &time, rand, 100);
+        }
+    }
+
+    /* Jumps across the whole range of every field, including a time before the epoch */
+    struct gridctl_archive_sample extremes[] = {
+        { .time = 0, .channel = 5, .fan_type = 2, .rpm = G_MAXUINT16, .current_ma = G_MAXUINT32 },
+        { .time = G_MAXINT64 / 4, .channel = 5, .fan_type = 2, .voltage_mv = G_MAXUINT32 },
+        { .time = -1, .channel = 5, .fan_type = 2, .rpm = G_MAXUINT16 },
+    };
+    g_array_append_vals(samples, extremes, G_N_ELEMENTS(extremes));
+
+    {
+        g_autoptr(GridctlArchiveWriter) writer = gridctl_archive_writer_new(path, &error);
+        g_assert_no_error(error);
+
+        write_samples(writer, samples);
+        g_assert_true(gridctl_archive_writer_flush(writer, &error));
+        g_assert_no_error(error);
+
+        gridctl_archive_writer_get_stats(writer, &writer_stats);
+        g_assert_cmpuint(writer_stats.n_samples, ==, samples->len);
+        g_assert_cmpuint(writer_stats.n_blocks, >, 2 * NZXT_GRID_V3_CHANNEL_COUNT + 2);
+    }
+
+    assert_archive_contains(path, samples);
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    g_assert_no_error(error);
+
+    gridctl_archive_reader_get_stats(reader, &reader_stats);
+    g_assert_cmpuint(reader_stats.n_blocks, ==, writer_stats.n_blocks);
+    g_assert_cmpuint(reader_stats.file_size,
+                     ==,
+                     sizeof(struct gridctl_archive_file_header)
+                         + writer_stats.n_blocks * GRIDCTL_ARCHIVE_BLOCK_SIZE);
+
+    g_clear_pointer(&reader, gridctl_archive_reader_free);
+    g_unlink(path);
+}
+
+static gboolean
+stop_cb(const struct gridctl_archive_sample *sample, gpointer user_data)
+{
+    guint *n = user_data;
+    return --*n > 0;
+}
+
+static void
+test_archive_range(void)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = archive_path("range");
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GRand) rand = g_rand_new_with_seed(2);
+    struct gridctl_archive_query query;
+    struct gridctl_archive_stats stats;
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        gint64 time = TEST_TIME;
+        add_samples(samples, channel, 2, &time, rand, 5000);
+    }
+
+    write_archive(path, samples);
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    g_assert_no_error(error);
+
+    /* Bounds are inclusive, so start and end queries exactly on sample times */
+    for (guint i = 0; i < 200; i++) {
+        guint index = (guint)g_rand_int_range(rand, 0, (gint32)samples->len);
+        const struct gridctl_archive_sample *from
+            = &g_array_index(samples, struct gridctl_archive_sample, index);
+
+        gridctl_archive_query_init(&query);
+        query.channel = i % 2 ? from->channel : GRIDCTL_ARCHIVE_ANY_CHANNEL;
+        query.time_from = from->time + (i % 3 == 0 ? 1 : 0);
+        query.time_to = from->time + g_rand_int_range(rand, 0, 60 * 1000);
+        if (i % 5 == 0) {
+            query.rpm_min = 20000;
+            query.rpm_max = 40000;
+        }
+
+        assert_query(reader, samples, &query, &stats);
+        g_assert_cmpuint(stats.n_blocks_skipped, >, 0);
+    }
+
+    /* Ranges that start on the last sample of a block or end on the first one */
+    g_autofree gchar *contents = NULL;
+    gsize length;
+
+    g_assert_true(g_file_get_contents(path, &contents, &length, &error));
+    g_assert_no_error(error);
+
+    for (gsize offset = sizeof(struct gridctl_archive_file_header); offset < length;
+         offset += GRIDCTL_ARCHIVE_BLOCK_SIZE)
+    {
+        struct gridctl_archive_block_header header;
+
+        memcpy(&header, contents + offset, sizeof(header));
+
+        gridctl_archive_query_init(&query);
+        query.channel = header.channel;
+        query.time_from = GINT64_FROM_LE(header.time_max);
+        query.time_to = query.time_from + 1000;
+        assert_query(reader, samples, &query, NULL);
+
+        query.time_to = GINT64_FROM_LE(header.time_min);
+        query.time_from = query.time_to - 1000;
+        assert_query(reader, samples, &query, NULL);
+    }
+
+    /* Outside of the archive, and a channel that doesn't exist */
+    gridctl_archive_query_init(&query);
+    query.time_to = TEST_TIME - 1;
+    assert_query(reader, samples, &query, &stats);
+    g_assert_cmpuint(stats.n_blocks_skipped, ==, stats.n_blocks);
+
+    gridctl_archive_query_init(&query);
+    query.channel = 0;
+    query.time_from = G_MAXINT64;
+    assert_query(reader, samples, &query, NULL);
+
+    gridctl_archive_query_init(&query);
+    query.channel = NZXT_GRID_V3_CHANNEL_COUNT;
+    assert_query(reader, samples, &query, NULL);
+
+    /* Stopping early */
+    guint n = 10;
+    gridctl_archive_query_init(&query);
+    g_assert_false(gridctl_archive_reader_query(reader, &query, stop_cb, &n, &stats));
+    g_assert_cmpuint(n, ==, 0);
+    g_assert_cmpuint(stats.n_samples, ==, 10);
+
+    g_clear_pointer(&reader, gridctl_archive_reader_free);
+    g_unlink(path);
+}
+
+static void
+test_archive_backwards(void)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = archive_path("backwards");
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GRand) rand = g_rand_new_with_seed(3);
+    gint64 time = TEST_TIME;
+    struct gridctl_archive_query query;
+
+    /* The wall clock steps back in the middle of a block, twice, so the blocks overlap in time */
+    add_samples(samples, 0, 2, &time, rand, 3000);
+    time -= 2 * MINUTE;
+    add_samples(samples, 0, 2, &time, rand, 3000);
+    time -= 4 * MINUTE;
+    add_samples(samples, 0, 2, &time, rand, 3000);
+    add_samples(samples, 1, 2, &time, rand, 3000);
+
+    write_archive(path, samples);
+    assert_archive_contains(path, samples);
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    g_assert_no_error(error);
+
+    /* Ranges that overlap both sides of a step still find every sample */
+    for (guint i = 0; i < 100; i++) {
+        gridctl_archive_query_init(&query);
+        query.channel = i % 2 ? 0 : GRIDCTL_ARCHIVE_ANY_CHANNEL;
+        query.time_from = TEST_TIME + g_rand_int_range(rand, 0, 10 * MINUTE);
+        query.time_to = query.time_from + g_rand_int_range(rand, 0, 3 * MINUTE);
+
+        assert_query(reader, samples, &query, NULL);
+    }
+
+    g_clear_pointer(&reader, gridctl_archive_reader_free);
+    g_unlink(path);
+}
+
+static void
+truncate_file(const gchar *path, gsize size)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *contents = NULL;
+    gsize length;
+
+    g_assert_true(g_file_get_contents(path, &contents, &length, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(size, <=, length);
+
+    g_assert_true(g_file_set_contents(path, contents, (gssize)size, &error));
+    g_assert_no_error(error);
+}
+
+static void
+test_archive_torn(void)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = archive_path("torn");
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GArray) torn = g_array_new(FALSE, FALSE, sizeof(struct gridctl_archive_sample));
+    g_autoptr(GRand) rand = g_rand_new_with_seed(4);
+    gint64 time = TEST_TIME;
+    struct gridctl_archive_stats stats;
+
+    add_samples(samples, 3, 2, &time, rand, 1000);
+    write_archive(path, samples);
+
+    /* A crash halfway through writing the next block */
+    add_samples(torn, 3, 2, &time, rand, 100);
+    write_archive(path, torn);
+
+    {
+        g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+        g_assert_no_error(error);
+        gridctl_archive_reader_get_stats(reader, &stats);
+    }
+
+    truncate_file(path, stats.file_size - GRIDCTL_ARCHIVE_BLOCK_SIZE / 2);
+    assert_archive_contains(path, samples);
+
+    /* The next writer overwrites the torn block */
+    g_array_set_size(torn, 0);
+    add_samples(torn, 3, 2, &time, rand, 100);
+    write_archive(path, torn);
+    g_array_append_vals(samples, torn->data, torn->len);
+    assert_archive_contains(path, samples);
+
+    g_autoptr(GridctlArchiveReader) reader = gridctl_archive_reader_new(path, &error);
+    g_assert_no_error(error);
+    gridctl_archive_reader_get_stats(reader, &stats);
+    g_assert_cmpuint(
+        (stats.file_size - sizeof(struct gridctl_archive_file_header)) % GRIDCTL_ARCHIVE_BLOCK_SIZE,
+        ==,
+        0);
+    g_clear_pointer(&reader, gridctl_archive_reader_free);
+
+    /* Not even a whole file header */
+    truncate_file(path, sizeof(struct gridctl_archive_file_header) - 1);
+    g_assert_null(gridctl_archive_reader_new(path, &error));
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+
+    g_unlink(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GError) error = NULL;
+    int status;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmp_dir = g_dir_make_tmp("gridctl-test-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    g_test_add_func("/archive/round-trip", test_archive_round_trip);
+    g_test_add_func("/archive/range", test_archive_range);
+    g_test_add_func("/archive/backwards", test_archive_backwards);
+    g_test_add_func("/archive/torn", test_archive_torn);
+
+    status = g_test_run();
+
+    g_rmdir(tmp_dir);
+    g_free(tmp_dir);
+    return status;
+}
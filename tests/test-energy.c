@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "energy.h"
+
+#define DAY (24 * G_GINT64_CONSTANT(3600) * G_USEC_PER_SEC)
+
+static gchar *tmp_dir;
+
+/* 12 V, so the power is 0.12 W per centiamp and exactly representable for small currents */
+static void
+make_report(struct nzxt_grid_status_report *report, guint channel, guint centiamps)
+{
+    memset(report, 0, sizeof(*report));
+    report->report_id = NZXT_GRID_STATUS_REPORT_ID;
+    report->in_volt = 12;
+    report->curr_amp = (guint8)(centiamps / 100);
+    report->curr_centiamp = (guint8)(centiamps % 100);
+    report->channel_index_and_fan_type = (guint8)(channel << 4 | 2);
+}
+
+static void
+add_report(struct gridctl_energy_meter *meter, guint channel, guint centiamps, gint64 time)
+{
+    struct nzxt_grid_status_report report;
+
+    make_report(&report, channel, centiamps);
+    gridctl_energy_meter_add_report(meter, &report, time);
+}
+
+static void
+test_energy_trapezoid(void)
+{
+    struct gridctl_energy_meter meter;
+
+    gridctl_energy_meter_init(&meter);
+
+    /* 3 W, then 6 W a second later, then back to 3 W two seconds after that */
+    add_report(&meter, 1, 25, 0);
+    g_assert_cmpfloat(gridctl_energy_meter_get_power(&meter, 1), ==, 3);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 1), ==, 0);
+
+    add_report(&meter, 1, 50, G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_power(&meter, 1), ==, 6);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 1), ==, 4.5);
+
+    add_report(&meter, 1, 25, 3 * G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 1), ==, 4.5 + 9);
+
+    /* Repeated or backwards times and unknown channels add nothing */
+    add_report(&meter, 1, 50, 3 * G_USEC_PER_SEC);
+    add_report(&meter, 1, 50, 2 * G_USEC_PER_SEC);
+    add_report(&meter, NZXT_GRID_V3_CHANNEL_COUNT, 50, 4 * G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 1), ==, 4.5 + 9);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        if (channel != 1) {
+            g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, channel), ==, 0);
+        }
+    }
+}
+
+static void
+test_energy_day(void)
+{
+    struct gridctl_energy_meter meter;
+    gint64 period = G_USEC_PER_SEC / 10;
+
+    gridctl_energy_meter_init(&meter);
+
+    /* A day at gridctl-sim's rate, 0.3 J at a time, which loses precision if summed naively */
+    for (gint64 time = 0; time <= DAY; time += period) {
+        add_report(&meter, 0, 25, time);
+    }
+
+    g_assert_cmpfloat_with_epsilon(
+        gridctl_energy_meter_get_energy(&meter, 0), 3.0 * DAY / G_USEC_PER_SEC, 1e-6);
+}
+
+static void
+test_energy_gap(void)
+{
+    struct gridctl_energy_meter meter;
+
+    gridctl_energy_meter_init(&meter);
+
+    add_report(&meter, 2, 25, 0);
+    add_report(&meter, 2, 25, GRIDCTL_ENERGY_MAX_GAP);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 2), ==, 30);
+
+    /* The interval across the gap is skipped, the next one counts again */
+    add_report(&meter, 2, 50, 2 * GRIDCTL_ENERGY_MAX_GAP + 1);
+    g_assert_cmpfloat(gridctl_energy_meter_get_power(&meter, 2), ==, 6);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 2), ==, 30);
+
+    add_report(&meter, 2, 50, 2 * GRIDCTL_ENERGY_MAX_GAP + 1 + G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 2), ==, 36);
+
+    /* A meter fed at a longer sample interval integrates across it */
+    gridctl_energy_meter_set_max_gap(&meter, 3 * GRIDCTL_ENERGY_MAX_GAP);
+    add_report(&meter, 2, 50, 4 * GRIDCTL_ENERGY_MAX_GAP + 1 + G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 2), ==, 36 + 120);
+}
+
+static void
+test_energy_time_zero(void)
+{
+    struct gridctl_energy_meter meter;
+
+    gridctl_energy_meter_init(&meter);
+
+    /* A first report at time 0 is still a starting point */
+    add_report(&meter, 3, 25, 0);
+    add_report(&meter, 3, 25, G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 3), ==, 3);
+
+    /* And a later first report isn't integrated from time 0 */
+    add_report(&meter, 4, 25, G_USEC_PER_SEC);
+    g_assert_cmpfloat(gridctl_energy_meter_get_power(&meter, 4), ==, 3);
+    g_assert_cmpfloat(gridctl_energy_meter_get_energy(&meter, 4), ==, 0);
+}
+
+static void
+test_energy_save_load(void)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = g_build_filename(tmp_dir, "energy.ini", NULL);
+    struct gridctl_energy_meter meter;
+    struct gridctl_energy_meter loaded;
+
+    gridctl_energy_meter_init(&meter);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        meter.channels[channel].energy_j = 1e9 / 3 * (channel + 1);
+        meter.channels[channel].energy_compensation_j = 1e-7 / 3 * (channel + 1);
+    }
+
+    g_assert_true(gridctl_energy_meter_save(&meter, path, &error));
+    g_assert_no_error(error);
+
+    gridctl_energy_meter_init(&loaded);
+    add_report(&loaded, 0, 25, G_USEC_PER_SEC);
+    g_assert_true(gridctl_energy_meter_load(&loaded, path, &error));
+    g_assert_no_error(error);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_assert_cmpfloat(loaded.channels[channel].energy_j, ==, meter.channels[channel].energy_j);
+        g_assert_cmpfloat(loaded.channels[channel].energy_compensation_j,
+                          ==,
+                          meter.channels[channel].energy_compensation_j);
+    }
+
+    /* Loading keeps the report state, only totals are restored */
+    g_assert_true(loaded.channels[0].has_last);
+    g_assert_cmpint(loaded.channels[0].last_time, ==, G_USEC_PER_SEC);
+
+    g_assert_true(g_file_set_contents(path, "[channel0]\nenergy_j=bogus\n", -1, &error));
+    g_assert_false(gridctl_energy_meter_load(&loaded, path, &error));
+    g_assert_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+    g_clear_error(&error);
+
+    g_unlink(path);
+    g_assert_false(gridctl_energy_meter_load(&loaded, path, &error));
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GError) error = NULL;
+    int status;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmp_dir = g_dir_make_tmp("gridctl-test-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    g_test_add_func("/energy/trapezoid", test_energy_trapezoid);
+    g_test_add_func("/energy/day", test_energy_day);
+    g_test_add_func("/energy/gap", test_energy_gap);
+    g_test_add_func("/energy/time-zero", test_energy_time_zero);
+    g_test_add_func("/energy/save-load", test_energy_save_load);
+
+    status = g_test_run();
+
+    g_rmdir(tmp_dir);
+    g_free(tmp_dir);
+    return status;
+}
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "shm.h"
+
+#define N_READERS 4
+
+/* Long enough for readers to race a few million publishes */
+#define STRESS_DURATION_US (2 * G_USEC_PER_SEC)
+
+struct stress {
+    gchar *name;
+    GridctlShmWriter *writer;
+    volatile gint stop;
+};
+
+struct writer_thread {
+    struct stress *stress;
+    guint channel;
+    guint64 n_published;
+};
+
+struct reader_thread {
+    struct stress *stress;
+    guint64 n_snapshots;
+    guint64 n_missed;
+};
+
+static gchar *
+test_segment_name(void)
+{
+    return g_strdup_printf("/gridctl-test-%d", (int)getpid());
+}
+
+/* Every field of the n-th report of a channel is a function of n, so snapshots can be checked */
+static void
+make_report(struct nzxt_grid_status_report *report, guint channel, guint64 n)
+{
+    memset(report, 0, sizeof(*report));
+    report->report_id = NZXT_GRID_STATUS_REPORT_ID;
+    report->rpm = GUINT16_TO_BE((guint16)(n * 7));
+    report->in_volt = (guint8)(n % 13);
+    report->in_centivolt = (guint8)(n % 100);
+    report->curr_amp = (guint8)(n % 3);
+    report->curr_centiamp = (guint8)(n / 100 % 100);
+    report->channel_index_and_fan_type = (guint8)(channel << 4 | n % 3);
+}
+
+static gint64
+report_time(guint channel, guint64 n)
+{
+    return (gint64)n * 1000 + channel;
+}
+
+static void
+check_sample(guint channel, const struct gridctl_shm_sample *sample)
+{
+    struct nzxt_grid_status_report expected;
+    make_report(&expected, channel, sample->n_reports);
+
+    g_assert_cmpint(sample->time, ==, report_time(channel, sample->n_reports));
+    g_assert_cmpuint(sample->fan_type, ==, nzxt_grid_status_report_get_fan_type(&expected));
+    g_assert_cmpuint(sample->rpm, ==, nzxt_grid_status_report_get_rpm(&expected));
+    g_assert_cmpuint(sample->voltage_mv, ==, nzxt_grid_status_report_get_voltage_mv(&expected));
+    g_assert_cmpuint(sample->current_ma, ==, nzxt_grid_status_report_get_current_ma(&expected));
+}
+
+/* One thread per channel, like gridctl's single writer but with every slot busy at once */
+static gpointer
+writer_thread_func(gpointer data)
+{
+    struct writer_thread *thread = data;
+    struct nzxt_grid_status_report report;
+
+    while (!g_atomic_int_get(&thread->stress->stop)) {
+        guint64 n = ++thread->n_published;
+        make_report(&report, thread->channel, n);
+        gridctl_shm_writer_publish(thread->stress->writer, &report, report_time(thread->channel, n));
+    }
+
+    return NULL;
+}
+
+static gpointer
+reader_thread_func(gpointer data)
+{
+    struct reader_thread *thread = data;
+    g_autoptr(GError) error = NULL;
+    const struct gridctl_shm_segment *segment = gridctl_shm_map(thread->stress->name, &error);
+    guint64 last[NZXT_GRID_V3_CHANNEL_COUNT] = { 0 };
+
+    g_assert_no_error(error);
+    g_assert_cmpuint(segment->header.n_channels, ==, NZXT_GRID_V3_CHANNEL_COUNT);
+
+    while (!g_atomic_int_get(&thread->stress->stop)) {
+        for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+            struct gridctl_shm_sample sample;
+
+            if (!gridctl_shm_read_sample(segment, channel, &sample)) {
+                thread->n_missed++;
+                continue;
+            }
+
+            check_sample(channel, &sample);
+            g_assert_cmpuint(sample.n_reports, >=, last[channel]);
+            last[channel] = sample.n_reports;
+            thread->n_snapshots++;
+        }
+    }
+
+    g_assert_true(gridctl_shm_is_live(segment));
+    gridctl_shm_unmap(segment);
+    return NULL;
+}
+
+static void
+test_shm_stress(void)
+{
+    g_autoptr(GError) error = NULL;
+    struct stress stress = { .name = test_segment_name() };
+    struct writer_thread writers[NZXT_GRID_V3_CHANNEL_COUNT];
+    struct reader_thread readers[N_READERS];
+    GThread *threads[NZXT_GRID_V3_CHANNEL_COUNT + N_READERS];
+    guint n_threads = 0;
+
+    stress.writer = gridctl_shm_writer_new(stress.name, &error);
+    g_assert_no_error(error);
+
+    for (guint i = 0; i < N_READERS; i++) {
+        readers[i] = (struct reader_thread){ .stress = &stress };
+        threads[n_threads++] = g_thread_new("reader", reader_thread_func, &readers[i]);
+    }
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        writers[channel] = (struct writer_thread){ .stress = &stress, .channel = channel };
+        threads[n_threads++] = g_thread_new("writer", writer_thread_func, &writers[channel]);
+    }
+
+    g_usleep(STRESS_DURATION_US);
+    g_atomic_int_set(&stress.stop, TRUE);
+
+    for (guint i = 0; i < n_threads; i++) {
+        g_thread_join(threads[i]);
+    }
+
+    guint64 n_published = 0;
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        g_assert_cmpuint(writers[channel].n_published, >, 0);
+        n_published += writers[channel].n_published;
+    }
+
+    for (guint i = 0; i < N_READERS; i++) {
+        g_assert_cmpuint(readers[i].n_snapshots, >, 0);
+        g_test_message("reader %u: %" G_GUINT64_FORMAT " snapshots, %" G_GUINT64_FORMAT
+                       " gave up",
+                       i,
+                       readers[i].n_snapshots,
+                       readers[i].n_missed);
+    }
+
+    g_test_message("%" G_GUINT64_FORMAT " reports published", n_published);
+
+    /* The final state is what a reader sees once the writers are done */
+    const struct gridctl_shm_segment *segment = gridctl_shm_map(stress.name, &error);
+    g_assert_no_error(error);
+
+    for (guint channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        struct gridctl_shm_sample sample;
+
+        g_assert_true(gridctl_shm_read_sample(segment, channel, &sample));
+        g_assert_cmpuint(sample.n_reports, ==, writers[channel].n_published);
+        check_sample(channel, &sample);
+    }
+
+    gridctl_shm_unmap(segment);
+    gridctl_shm_writer_free(stress.writer);
+    g_free(stress.name);
+}
+
+static void
+test_shm_in_use(void)
+{
+    g_autofree gchar *name = test_segment_name();
+    g_autoptr(GError) error = NULL;
+    GridctlShmWriter *writer = gridctl_shm_writer_new(name, &error);
+
+    g_assert_no_error(error);
+
+    /* A second writer must not take over, and then unlink, a segment that is being published */
+    g_assert_null(gridctl_shm_writer_new(name, &error));
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_EXIST);
+    g_clear_error(&error);
+
+    const struct gridctl_shm_segment *segment = gridctl_shm_map(name, &error);
+    g_assert_no_error(error);
+    g_assert_true(gridctl_shm_is_live(segment));
+    gridctl_shm_unmap(segment);
+
+    gridctl_shm_writer_free(writer);
+
+    writer = gridctl_shm_writer_new(name, &error);
+    g_assert_no_error(error);
+    gridctl_shm_writer_free(writer);
+}
+
+static void
+test_shm_stale(void)
+{
+    g_autofree gchar *name = test_segment_name();
+    g_autoptr(GError) error = NULL;
+    pid_t pid = fork();
+    int status;
+
+    /* A writer that dies without cleaning up leaves a live-looking segment behind */
+    if (pid == 0) {
+        _exit(gridctl_shm_writer_new(name, NULL) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    g_assert_cmpint(waitpid(pid, &status, 0), ==, pid);
+    g_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    const struct gridctl_shm_segment *segment = gridctl_shm_map(name, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(segment->header.writer_pid, ==, pid);
+    gridctl_shm_unmap(segment);
+
+    GridctlShmWriter *writer = gridctl_shm_writer_new(name, &error);
+    g_assert_no_error(error);
+
+    segment = gridctl_shm_map(name, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(segment->header.writer_pid, ==, getpid());
+    gridctl_shm_unmap(segment);
+
+    gridctl_shm_writer_free(writer);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/shm/stress", test_shm_stress);
+    g_test_add_func("/shm/in-use", test_shm_in_use);
+    g_test_add_func("/shm/stale", test_shm_stale);
+
+    return g_test_run();
+}
@@ -0,0 +1,423 @@
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "device.h"
+#include "hid.h"
+#include "recordwriter.h"
+#include "virtualclock.h"
+
+#define DAY (24 * G_GINT64_CONSTANT(3600) * G_USEC_PER_SEC)
+
+/* gridctl-sim's default rate */
+#define REPORT_PERIOD (G_USEC_PER_SEC / 10)
+
+/*
+ * Stands in for hidraw: the device sends a report every period of virtual time, and reports that
+ * arrive while GRIDCTL_HID_QUEUE_LENGTH are unread are dropped, like the kernel does.
+ */
+#define TEST_TYPE_HID_STREAM (test_hid_stream_get_type())
+G_DECLARE_FINAL_TYPE(TestHidStream, test_hid_stream, TEST, HID_STREAM, GInputStream)
+
+struct _TestHidStream {
+    GInputStream parent_instance;
+
+    GridctlClock *clock;
+    gint64 period;
+    guint n_errors; /* reads to fail before delivering anything */
+    GIOErrorEnum error_code;
+
+    guint64 n_sent;
+    guint64 n_dropped;
+    guint64 queue[GRIDCTL_HID_QUEUE_LENGTH];
+    guint queue_head;
+    guint queue_length;
+};
+
+static void
+pollable_iface_init(GPollableInputStreamInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(TestHidStream,
+                        test_hid_stream,
+                        G_TYPE_INPUT_STREAM,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_POLLABLE_INPUT_STREAM, pollable_iface_init))
+
+/* Every field of the n-th report is a function of n */
+static void
+make_report(struct nzxt_grid_status_report *report, guint64 n)
+{
+    memset(report, 0, sizeof(*report));
+    report->report_id = NZXT_GRID_STATUS_REPORT_ID;
+    report->rpm = GUINT16_TO_BE((guint16)(600 + n % 1000));
+    report->in_volt = 12;
+    report->curr_centiamp = 25;
+    report->channel_index_and_fan_type = (guint8)((n % NZXT_GRID_V3_CHANNEL_COUNT) << 4 | 2);
+}
+
+static void
+update_queue(TestHidStream *stream)
+{
+    guint64 n_sent = (guint64)(gridctl_clock_get_time(stream->clock) / stream->period);
+
+    for (; stream->n_sent < n_sent; stream->n_sent++) {
+        if (stream->queue_length == GRIDCTL_HID_QUEUE_LENGTH) {
+            stream->n_dropped++;
+            continue;
+        }
+
+        guint tail = (stream->queue_head + stream->queue_length) % GRIDCTL_HID_QUEUE_LENGTH;
+        stream->queue[tail] = stream->n_sent;
+        stream->queue_length++;
+    }
+}
+
+static gssize
+read_nonblocking(GPollableInputStream *pollable, void *buffer, gsize count, GError **error)
+{
+    TestHidStream *stream = TEST_HID_STREAM(pollable);
+
+    if (stream->n_errors) {
+        stream->n_errors--;
+        g_set_error_literal(error, G_IO_ERROR, stream->error_code, "Synthetic read error");
+        return -1;
+    }
+
+    update_queue(stream);
+
+    if (stream->queue_length == 0) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK, "No report queued");
+        return -1;
+    }
+
+    g_assert_cmpuint(count, >=, sizeof(struct nzxt_grid_status_report));
+    make_report(buffer, stream->queue[stream->queue_head]);
+    stream->queue_head = (stream->queue_head + 1) % GRIDCTL_HID_QUEUE_LENGTH;
+    stream->queue_length--;
+    return sizeof(struct nzxt_grid_status_report);
+}
+
+/* Virtual time never wakes up a poll, so blocking reads can't wait either */
+static gssize
+read_fn(GInputStream *stream, void *buffer, gsize count, GCancellable *cancellable, GError **error)
+{
+    return read_nonblocking(G_POLLABLE_INPUT_STREAM(stream), buffer, count, error);
+}
+
+static gboolean
+can_poll(GPollableInputStream *pollable)
+{
+    return TRUE;
+}
+
+static gboolean
+is_readable(GPollableInputStream *pollable)
+{
+    TestHidStream *stream = TEST_HID_STREAM(pollable);
+
+    update_queue(stream);
+    return stream->queue_length != 0;
+}
+
+static GSource *
+create_source(GPollableInputStream *pollable, GCancellable *cancellable)
+{
+    return g_pollable_source_new_full(pollable, NULL, cancellable);
+}
+
+static void
+pollable_iface_init(GPollableInputStreamInterface *iface)
+{
+    iface->can_poll = can_poll;
+    iface->is_readable = is_readable;
+    iface->create_source = create_source;
+    iface->read_nonblocking = read_nonblocking;
+}
+
+static void
+finalize(GObject *object)
+{
+    g_object_unref(TEST_HID_STREAM(object)->clock);
+
+    G_OBJECT_CLASS(test_hid_stream_parent_class)->finalize(object);
+}
+
+static void
+test_hid_stream_class_init(TestHidStreamClass *class)
+{
+    G_OBJECT_CLASS(class)->finalize = finalize;
+    G_INPUT_STREAM_CLASS(class)->read_fn = read_fn;
+}
+
+static void
+test_hid_stream_init(TestHidStream *obj)
+{
+}
+
+static TestHidStream *
+test_hid_stream_new(GridctlClock *clock, gint64 period)
+{
+    TestHidStream *stream = g_object_new(TEST_TYPE_HID_STREAM, NULL);
+
+    stream->clock = g_object_ref(clock);
+    stream->period = period;
+    return stream;
+}
+
+static void
+iterate_main_context(void)
+{
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+}
+
+struct samples {
+    GridctlClock *clock;
+    guint64 n_samples;
+    guint64 n_reports;
+};
+
+static void
+sample_cb(GridctlDevice *device, const struct gridctl_channel_stats *stats, gpointer user_data)
+{
+    struct samples *samples = user_data;
+
+    g_assert_cmpuint(stats->channel, <, NZXT_GRID_V3_CHANNEL_COUNT);
+    g_assert_cmpuint(stats->fan_type, ==, 2);
+    g_assert_cmpuint(stats->rpm_min, <=, stats->rpm);
+    g_assert_cmpuint(stats->rpm, <=, stats->rpm_max);
+    g_assert_cmpint(stats->time, ==, gridctl_clock_get_time(samples->clock));
+
+    samples->n_samples++;
+    samples->n_reports += stats->n_reports;
+}
+
+/* A day of low-power sampling, which takes as long as draining the reports does */
+static void
+test_soak_sample_day(void)
+{
+    g_autoptr(GridctlClock) clock = gridctl_virtual_clock_new(0);
+    g_autoptr(TestHidStream) stream = test_hid_stream_new(clock, REPORT_PERIOD);
+    g_autoptr(GridctlDevice) device
+        = gridctl_device_new_with_clock(G_INPUT_STREAM(stream), clock);
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+    struct samples samples = { .clock = clock };
+    gint64 start = g_get_monotonic_time();
+
+    g_signal_connect(device, "sample", G_CALLBACK(sample_cb), &samples);
+    gridctl_device_set_sample_interval(device, 1000);
+    gridctl_device_start(device);
+
+    while (gridctl_clock_get_time(clock) < DAY) {
+        g_assert_true(gridctl_virtual_clock_advance_to_next(virtual_clock));
+    }
+
+    g_test_message("A day of reports took %.2f s",
+                   (gdouble)(g_get_monotonic_time() - start) / G_USEC_PER_SEC);
+
+    g_assert_cmpint(gridctl_clock_get_time(clock), ==, DAY);
+    g_assert_cmpuint(gridctl_device_get_wakeup_count(device), ==, DAY / G_USEC_PER_SEC);
+    g_assert_cmpuint(gridctl_device_get_report_count(device), ==, DAY / REPORT_PERIOD);
+    g_assert_cmpuint(stream->n_dropped, ==, 0);
+    g_assert_cmpuint(samples.n_samples, ==, DAY / G_USEC_PER_SEC * NZXT_GRID_V3_CHANNEL_COUNT);
+    g_assert_cmpuint(samples.n_reports, ==, DAY / REPORT_PERIOD);
+
+    gridctl_device_stop(device);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 0);
+}
+
+/* Reports beyond the kernel queue are lost, and that is warned about once */
+static void
+test_soak_sample_queue_full(void)
+{
+    g_autoptr(GridctlClock) clock = gridctl_virtual_clock_new(0);
+    g_autoptr(TestHidStream) stream = test_hid_stream_new(clock, REPORT_PERIOD);
+    g_autoptr(GridctlDevice) device
+        = gridctl_device_new_with_clock(G_INPUT_STREAM(stream), clock);
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+    struct samples samples = { .clock = clock };
+
+    g_signal_connect(device, "sample", G_CALLBACK(sample_cb), &samples);
+    gridctl_device_set_sample_interval(device, 10000);
+    gridctl_device_start(device);
+
+    g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "Read 64 reports in one wakeup*");
+    g_assert_true(gridctl_virtual_clock_advance_to_next(virtual_clock));
+    g_test_assert_expected_messages();
+
+    g_assert_true(gridctl_virtual_clock_advance_to_next(virtual_clock));
+
+    g_assert_cmpuint(gridctl_device_get_report_count(device), ==, 2 * GRIDCTL_HID_QUEUE_LENGTH);
+    g_assert_cmpuint(stream->n_dropped, ==, 2 * (100 - GRIDCTL_HID_QUEUE_LENGTH));
+    g_assert_cmpuint(samples.n_reports, ==, 2 * GRIDCTL_HID_QUEUE_LENGTH);
+
+    gridctl_device_stop(device);
+}
+
+static void
+report_cb(GridctlDevice *device,
+          const struct nzxt_grid_status_report *report,
+          gint64 time,
+          gpointer user_data)
+{
+    g_array_append_val((GArray *)user_data, time);
+}
+
+/* A transient read error is retried a second later, whatever was queued meanwhile is read then */
+static void
+test_soak_read_retry(void)
+{
+    g_autoptr(GridctlClock) clock = gridctl_virtual_clock_new(0);
+    g_autoptr(TestHidStream) stream = test_hid_stream_new(clock, REPORT_PERIOD);
+    g_autoptr(GridctlDevice) device
+        = gridctl_device_new_with_clock(G_INPUT_STREAM(stream), clock);
+    g_autoptr(GArray) times = g_array_new(FALSE, FALSE, sizeof(gint64));
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+
+    stream->n_errors = 1;
+    stream->error_code = G_IO_ERROR_BUSY;
+    g_signal_connect(device, "report", G_CALLBACK(report_cb), times);
+
+    g_test_expect_message(
+        G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "g_input_stream_read_async: Synthetic read error");
+    gridctl_device_start(device);
+    iterate_main_context();
+    g_test_assert_expected_messages();
+
+    g_assert_cmpuint(gridctl_device_get_wakeup_count(device), ==, 1);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 1);
+
+    gridctl_virtual_clock_advance(virtual_clock, G_USEC_PER_SEC - 1);
+    iterate_main_context();
+    g_assert_cmpuint(times->len, ==, 0);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 1);
+
+    gridctl_virtual_clock_advance(virtual_clock, 1);
+    iterate_main_context();
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 0);
+    g_assert_cmpuint(times->len, ==, G_USEC_PER_SEC / REPORT_PERIOD);
+
+    for (guint i = 0; i < times->len; i++) {
+        g_assert_cmpint(g_array_index(times, gint64, i), ==, G_USEC_PER_SEC);
+    }
+
+    gridctl_device_stop(device);
+    iterate_main_context();
+}
+
+static void
+closed_cb(GridctlDevice *device, gpointer user_data)
+{
+    (*(guint *)user_data)++;
+}
+
+/* hidraw fails reads with EIO after an unplug, which must end the stream rather than retry */
+static void
+test_soak_read_disconnect(void)
+{
+    g_autoptr(GridctlClock) clock = gridctl_virtual_clock_new(0);
+    g_autoptr(TestHidStream) stream = test_hid_stream_new(clock, REPORT_PERIOD);
+    g_autoptr(GridctlDevice) device
+        = gridctl_device_new_with_clock(G_INPUT_STREAM(stream), clock);
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+    guint n_closed = 0;
+
+    stream->n_errors = 1;
+    stream->error_code = G_IO_ERROR_FAILED;
+    g_signal_connect(device, "closed", G_CALLBACK(closed_cb), &n_closed);
+
+    g_test_expect_message(
+        G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "g_input_stream_read_async: Synthetic read error");
+    gridctl_device_start(device);
+    iterate_main_context();
+    g_test_assert_expected_messages();
+
+    g_assert_cmpuint(n_closed, ==, 1);
+    g_assert_false(gridctl_device_is_running(device));
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 0);
+
+    /* Same in low-power mode, where the error comes from a drain */
+    stream->n_errors = 1;
+    gridctl_device_set_sample_interval(device, 1000);
+    gridctl_device_start(device);
+
+    g_test_expect_message(G_LOG_DOMAIN,
+                          G_LOG_LEVEL_WARNING,
+                          "g_pollable_input_stream_read_nonblocking: Synthetic read error");
+    g_assert_true(gridctl_virtual_clock_advance_to_next(virtual_clock));
+    g_test_assert_expected_messages();
+
+    g_assert_cmpuint(n_closed, ==, 2);
+    g_assert_false(gridctl_device_is_running(device));
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 0);
+}
+
+static guint
+count_lines(GMemoryOutputStream *stream)
+{
+    const gchar *data = g_memory_output_stream_get_data(stream);
+    gsize size = g_memory_output_stream_get_data_size(stream);
+    guint n_lines = 0;
+
+    for (gsize i = 0; i < size; i++) {
+        n_lines += data[i] == '\n';
+    }
+
+    return n_lines;
+}
+
+/* Records are held back no longer than the latency, counted from the oldest one */
+static void
+test_soak_record_latency(void)
+{
+    g_autoptr(GridctlClock) clock = gridctl_virtual_clock_new(0);
+    g_autoptr(GOutputStream) output = g_memory_output_stream_new_resizable();
+    g_autoptr(GridctlRecordWriter) writer
+        = gridctl_record_writer_new(output, clock, GRIDCTL_RECORD_FORMAT_NDJSON, 250);
+    GMemoryOutputStream *memory = G_MEMORY_OUTPUT_STREAM(output);
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+    g_autoptr(GError) error = NULL;
+    struct nzxt_grid_status_report report;
+
+    make_report(&report, 0);
+    g_assert_true(gridctl_record_writer_write_report(writer, &report, 1, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 1);
+
+    gridctl_virtual_clock_advance(virtual_clock, 100000);
+    make_report(&report, 1);
+    g_assert_true(gridctl_record_writer_write_report(writer, &report, 2, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 1);
+
+    gridctl_virtual_clock_advance(virtual_clock, 149999);
+    g_assert_cmpuint(g_memory_output_stream_get_data_size(memory), ==, 0);
+    g_assert_cmpuint(gridctl_record_writer_get_write_count(writer), ==, 0);
+
+    gridctl_virtual_clock_advance(virtual_clock, 1);
+    g_assert_cmpuint(count_lines(memory), ==, 2);
+    g_assert_cmpuint(gridctl_record_writer_get_write_count(writer), ==, 1);
+    g_assert_cmpuint(gridctl_virtual_clock_get_n_timeouts(virtual_clock), ==, 0);
+
+    /* The next record starts a new deadline */
+    make_report(&report, 2);
+    g_assert_true(gridctl_record_writer_write_report(writer, &report, 3, &error));
+    g_assert_no_error(error);
+    g_assert_true(gridctl_virtual_clock_advance_to_next(virtual_clock));
+    g_assert_cmpint(gridctl_clock_get_time(clock), ==, 500000);
+    g_assert_cmpuint(count_lines(memory), ==, 3);
+    g_assert_cmpuint(gridctl_record_writer_get_write_count(writer), ==, 2);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/soak/sample-day", test_soak_sample_day);
+    g_test_add_func("/soak/sample-queue-full", test_soak_sample_queue_full);
+    g_test_add_func("/soak/read-retry", test_soak_read_retry);
+    g_test_add_func("/soak/read-disconnect", test_soak_read_disconnect);
+    g_test_add_func("/soak/record-latency", test_soak_record_latency);
+
+    return g_test_run();
+}
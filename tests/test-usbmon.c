@@ -0,0 +1,578 @@
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "usbmon.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4U
+#define PCAP_MAGIC_NSEC 0xa1b23c4dU
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_USB_LINUX 189
+#define LINKTYPE_USB_LINUX_MMAPPED 220
+
+#define TEST_BUS 3
+#define GRID_ADDRESS 5
+#define OTHER_ADDRESS 6
+#define UNKNOWN_ADDRESS 7
+
+/* Capture start, in microseconds since the epoch */
+#define TEST_TIME (G_GINT64_CONSTANT(1700000000) * G_USEC_PER_SEC)
+
+static gchar *tmp_dir;
+
+/* Captures are generated here rather than checked in, in either byte order */
+struct builder {
+    GByteArray *data;
+    gboolean big_endian;
+};
+
+struct packet {
+    gint64 time;
+    guint8 type;
+    guint8 transfer_type;
+    guint8 endpoint;
+    guint8 address;
+    guint8 payload[32];
+    gsize payload_size;
+};
+
+struct result {
+    gint64 time;
+    guint16 bus;
+    guint8 address;
+    guint8 channel;
+    guint16 rpm;
+};
+
+static void
+put_bytes(struct builder *builder, const void *data, gsize size)
+{
+    g_byte_array_append(builder->data, data, (guint)size);
+}
+
+static void
+put_u8(struct builder *builder, guint8 value)
+{
+    put_bytes(builder, &value, sizeof(value));
+}
+
+static void
+put_u16(struct builder *builder, guint16 value)
+{
+    value = builder->big_endian ? GUINT16_TO_BE(value) : GUINT16_TO_LE(value);
+    put_bytes(builder, &value, sizeof(value));
+}
+
+static void
+put_u32(struct builder *builder, guint32 value)
+{
+    value = builder->big_endian ? GUINT32_TO_BE(value) : GUINT32_TO_LE(value);
+    put_bytes(builder, &value, sizeof(value));
+}
+
+static void
+put_u64(struct builder *builder, guint64 value)
+{
+    value = builder->big_endian ? GUINT64_TO_BE(value) : GUINT64_TO_LE(value);
+    put_bytes(builder, &value, sizeof(value));
+}
+
+static void
+put_padding(struct builder *builder)
+{
+    while (builder->data->len % 4) {
+        put_u8(builder, 0);
+    }
+}
+
+static gsize
+usbmon_header_size(guint16 link_type)
+{
+    return link_type == LINKTYPE_USB_LINUX_MMAPPED ? 64 : 48;
+}
+
+static void
+put_usbmon_packet(struct builder *builder, guint16 link_type, const struct packet *packet)
+{
+    put_u64(builder, 0xffff8880deadbeefU);
+    put_u8(builder, packet->type);
+    put_u8(builder, packet->transfer_type);
+    put_u8(builder, packet->endpoint);
+    put_u8(builder, packet->address);
+    put_u16(builder, TEST_BUS);
+    put_u8(builder, '-');
+    put_u8(builder, packet->payload_size ? 0 : '<');
+    put_u64(builder, (guint64)(packet->time / G_USEC_PER_SEC));
+    put_u32(builder, (guint32)(packet->time % G_USEC_PER_SEC));
+    put_u32(builder, 0);
+    put_u32(builder, (guint32)packet->payload_size);
+    put_u32(builder, (guint32)packet->payload_size);
+    put_u64(builder, 0);
+
+    if (link_type == LINKTYPE_USB_LINUX_MMAPPED) {
+        put_u32(builder, 1);
+        put_u32(builder, 0);
+        put_u32(builder, 0);
+        put_u32(builder, 0);
+    }
+
+    put_bytes(builder, packet->payload, packet->payload_size);
+}
+
+static void
+put_pcap_header(struct builder *builder, gboolean nsec, guint16 link_type)
+{
+    put_u32(builder, nsec ? PCAP_MAGIC_NSEC : PCAP_MAGIC_USEC);
+    put_u16(builder, 2);
+    put_u16(builder, 4);
+    put_u32(builder, 0);
+    put_u32(builder, 0);
+    put_u32(builder, 65535);
+    put_u32(builder, link_type);
+}
+
+static void
+put_pcap_record(struct builder *builder,
+                gboolean nsec,
+                guint16 link_type,
+                const struct packet *packet)
+{
+    guint32 size = (guint32)(usbmon_header_size(link_type) + packet->payload_size);
+    guint32 fraction = (guint32)(packet->time % G_USEC_PER_SEC);
+
+    /* The extra nanoseconds must be truncated, not rounded */
+    put_u32(builder, (guint32)(packet->time / G_USEC_PER_SEC));
+    put_u32(builder, nsec ? fraction * 1000 + 999 : fraction);
+    put_u32(builder, size);
+    put_u32(builder, size);
+    put_usbmon_packet(builder, link_type, packet);
+}
+
+static void
+put_pcapng_section_header(struct builder *builder)
+{
+    put_u32(builder, 0x0a0d0d0a);
+    put_u32(builder, 28);
+    put_u32(builder, 0x1a2b3c4d);
+    put_u16(builder, 1);
+    put_u16(builder, 0);
+    put_u64(builder, G_MAXUINT64);
+    put_u32(builder, 28);
+}
+
+/* tsresol 0 leaves out the option, for the default of microseconds */
+static void
+put_pcapng_interface(struct builder *builder, guint16 link_type, guint8 tsresol)
+{
+    guint32 size = tsresol ? 32 : 20;
+
+    put_u32(builder, 1);
+    put_u32(builder, size);
+    put_u16(builder, link_type);
+    put_u16(builder, 0);
+    put_u32(builder, 65535);
+
+    if (tsresol) {
+        put_u16(builder, 9);
+        put_u16(builder, 1);
+        put_u8(builder, tsresol);
+        put_padding(builder);
+        put_u16(builder, 0);
+        put_u16(builder, 0);
+    }
+
+    put_u32(builder, size);
+}
+
+static void
+put_pcapng_packet(struct builder *builder,
+                  guint32 interface_id,
+                  guint64 timestamp,
+                  const void *data,
+                  gsize size)
+{
+    guint32 block_size = 32 + (guint32)((size + 3) & ~(gsize)3);
+
+    put_u32(builder, 6);
+    put_u32(builder, block_size);
+    put_u32(builder, interface_id);
+    put_u32(builder, (guint32)(timestamp >> 32));
+    put_u32(builder, (guint32)timestamp);
+    put_u32(builder, (guint32)size);
+    put_u32(builder, (guint32)size);
+    put_bytes(builder, data, size);
+    put_padding(builder);
+    put_u32(builder, block_size);
+}
+
+static struct packet
+descriptor_packet(gint64 time, guint8 address, guint16 vendor_id, guint16 product_id)
+{
+    struct packet packet = {
+        .time = time,
+        .type = 'C',
+        .transfer_type = 2,
+        .endpoint = 0x80,
+        .address = address,
+        .payload = { 18, 1, 0x00, 0x02, 0, 0, 0, 64 },
+        .payload_size = 18,
+    };
+
+    /* Always little-endian, whatever the capture's byte order */
+    packet.payload[8] = vendor_id & 0xff;
+    packet.payload[9] = vendor_id >> 8;
+    packet.payload[10] = product_id & 0xff;
+    packet.payload[11] = product_id >> 8;
+    return packet;
+}
+
+static struct packet
+report_packet(gint64 time, guint8 address, guint8 report_id, guint8 channel, guint16 rpm)
+{
+    struct packet packet = {
+        .time = time,
+        .type = 'C',
+        .transfer_type = 1,
+        .endpoint = 0x81,
+        .address = address,
+        .payload_size = sizeof(struct nzxt_grid_status_report),
+    };
+    struct nzxt_grid_status_report *report = (void *)packet.payload;
+
+    report->report_id = report_id;
+    report->rpm = GUINT16_TO_BE(rpm);
+    report->in_volt = 12;
+    report->channel_index_and_fan_type = (guint8)(channel << 4 | 2);
+    return packet;
+}
+
+/*
+ * A Grid that is plugged in during the capture, with a submission and a report per channel. The
+ * submission has no data and must only show up in n_packets.
+ */
+static GArray *
+make_grid_packets(void)
+{
+    GArray *packets = g_array_new(FALSE, FALSE, sizeof(struct packet));
+    struct packet packet = descriptor_packet(
+        TEST_TIME, GRID_ADDRESS, USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_NZXT_GRID_V3);
+
+    g_array_append_val(packets, packet);
+
+    packet = report_packet(TEST_TIME + 1000, GRID_ADDRESS, 0, 0, 0);
+    packet.type = 'S';
+    packet.payload_size = 0;
+    g_array_append_val(packets, packet);
+
+    for (guint8 channel = 0; channel < NZXT_GRID_V3_CHANNEL_COUNT; channel++) {
+        packet = report_packet(TEST_TIME + 200000 * (channel + 1) + 123,
+                               GRID_ADDRESS,
+                               NZXT_GRID_STATUS_REPORT_ID,
+                               channel,
+                               (guint16)(1000 + channel));
+        g_array_append_val(packets, packet);
+    }
+
+    return packets;
+}
+
+static gchar *
+write_capture(const struct builder *builder, gsize size)
+{
+    g_autoptr(GError) error = NULL;
+    gchar *path = g_build_filename(tmp_dir, "capture", NULL);
+
+    g_file_set_contents(path, (const gchar *)builder->data->data, (gssize)size, &error);
+    g_assert_no_error(error);
+    return path;
+}
+
+static gboolean
+collect_report(const struct gridctl_usbmon_report *report, gpointer user_data)
+{
+    struct result result = {
+        .time = report->time,
+        .bus = report->bus,
+        .address = report->address,
+        .channel = nzxt_grid_status_report_get_channel(report->report),
+        .rpm = nzxt_grid_status_report_get_rpm(report->report),
+    };
+
+    g_array_append_val((GArray *)user_data, result);
+    return TRUE;
+}
+
+/* Imports the first size bytes of the capture, which is removed again */
+static GArray *
+import_capture(const struct builder *builder,
+               gsize size,
+               const struct gridctl_usbmon_filter *filter,
+               struct gridctl_usbmon_stats *stats,
+               GError **error)
+{
+    g_autofree gchar *path = write_capture(builder, size);
+    GArray *results = g_array_new(FALSE, FALSE, sizeof(struct result));
+
+    gridctl_usbmon_import(path, filter, collect_report, results, stats, error);
+    g_remove(path);
+    return results;
+}
+
+static void
+check_grid_results(GArray *results, const struct gridctl_usbmon_stats *stats)
+{
+    g_assert_cmpuint(stats->n_packets, ==, NZXT_GRID_V3_CHANNEL_COUNT + 2);
+    g_assert_cmpuint(stats->n_transfers, ==, NZXT_GRID_V3_CHANNEL_COUNT);
+    g_assert_cmpuint(stats->n_reports, ==, NZXT_GRID_V3_CHANNEL_COUNT);
+    g_assert_cmpuint(stats->n_invalid, ==, 0);
+    g_assert_cmpuint(stats->n_skipped, ==, 0);
+    g_assert_cmpuint(results->len, ==, NZXT_GRID_V3_CHANNEL_COUNT);
+
+    for (guint channel = 0; channel < results->len; channel++) {
+        const struct result *result = &g_array_index(results, struct result, channel);
+
+        g_assert_cmpint(result->time, ==, TEST_TIME + 200000 * (channel + 1) + 123);
+        g_assert_cmpuint(result->bus, ==, TEST_BUS);
+        g_assert_cmpuint(result->address, ==, GRID_ADDRESS);
+        g_assert_cmpuint(result->channel, ==, channel);
+        g_assert_cmpuint(result->rpm, ==, 1000 + channel);
+    }
+}
+
+struct pcap_variant {
+    const gchar *name;
+    gboolean big_endian;
+    gboolean nsec;
+    guint16 link_type;
+};
+
+static const struct pcap_variant pcap_variants[] = {
+    { "/usbmon/pcap/le", FALSE, FALSE, LINKTYPE_USB_LINUX },
+    { "/usbmon/pcap/be", TRUE, FALSE, LINKTYPE_USB_LINUX },
+    { "/usbmon/pcap/le-nsec", FALSE, TRUE, LINKTYPE_USB_LINUX },
+    { "/usbmon/pcap/le-mmapped", FALSE, FALSE, LINKTYPE_USB_LINUX_MMAPPED },
+    { "/usbmon/pcap/be-mmapped", TRUE, FALSE, LINKTYPE_USB_LINUX_MMAPPED },
+    { "/usbmon/pcap/be-nsec-mmapped", TRUE, TRUE, LINKTYPE_USB_LINUX_MMAPPED },
+};
+
+static void
+test_usbmon_pcap(gconstpointer data)
+{
+    const struct pcap_variant *variant = data;
+    g_autoptr(GByteArray) bytes = g_byte_array_new();
+    struct builder builder = { .data = bytes, .big_endian = variant->big_endian };
+    g_autoptr(GArray) packets = make_grid_packets();
+    struct gridctl_usbmon_filter filter = { 0 };
+    struct gridctl_usbmon_stats stats;
+    g_autoptr(GError) error = NULL;
+
+    put_pcap_header(&builder, variant->nsec, variant->link_type);
+    for (guint i = 0; i < packets->len; i++) {
+        put_pcap_record(
+            &builder, variant->nsec, variant->link_type, &g_array_index(packets, struct packet, i));
+    }
+
+    g_autoptr(GArray) results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    g_assert_no_error(error);
+    g_assert_cmpuint(stats.n_bytes, ==, bytes->len);
+    check_grid_results(results, &stats);
+}
+
+static void
+test_usbmon_pcapng(void)
+{
+    g_autoptr(GByteArray) bytes = g_byte_array_new();
+    struct builder builder = { .data = bytes };
+    g_autoptr(GArray) packets = make_grid_packets();
+    struct gridctl_usbmon_filter filter = { 0 };
+    struct gridctl_usbmon_stats stats;
+    g_autoptr(GError) error = NULL;
+    struct nzxt_grid_status_report lookalike = { .report_id = NZXT_GRID_STATUS_REPORT_ID };
+
+    /* Wireshark captures from several interfaces at once - only usbmon ones are decoded */
+    put_pcapng_section_header(&builder);
+    put_pcapng_interface(&builder, LINKTYPE_ETHERNET, 0);
+    put_pcapng_interface(&builder, LINKTYPE_USB_LINUX_MMAPPED, 9);
+
+    for (guint i = 0; i < packets->len; i++) {
+        const struct packet *packet = &g_array_index(packets, struct packet, i);
+        g_autoptr(GByteArray) usbmon = g_byte_array_new();
+        struct builder packet_builder = { .data = usbmon };
+
+        put_pcapng_packet(&builder, 0, 0, &lookalike, sizeof(lookalike));
+        put_usbmon_packet(&packet_builder, LINKTYPE_USB_LINUX_MMAPPED, packet);
+        put_pcapng_packet(
+            &builder, 1, (guint64)packet->time * 1000 + 999, usbmon->data, usbmon->len);
+    }
+
+    g_autoptr(GArray) results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    g_assert_no_error(error);
+    g_assert_cmpuint(stats.n_bytes, ==, bytes->len);
+    check_grid_results(results, &stats);
+}
+
+static void
+test_usbmon_pcapng_no_usbmon(void)
+{
+    g_autoptr(GByteArray) bytes = g_byte_array_new();
+    struct builder builder = { .data = bytes };
+    struct gridctl_usbmon_filter filter = { 0 };
+    struct gridctl_usbmon_stats stats;
+    g_autoptr(GError) error = NULL;
+    guint8 frame[60] = { 0 };
+
+    put_pcapng_section_header(&builder);
+    put_pcapng_interface(&builder, LINKTYPE_ETHERNET, 0);
+    put_pcapng_packet(&builder, 0, 0, frame, sizeof(frame));
+
+    g_autoptr(GArray) results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+    g_assert_cmpuint(results->len, ==, 0);
+    g_assert_cmpuint(stats.n_packets, ==, 0);
+}
+
+/*
+ * A Grid, some other device and a device whose descriptor is not in the capture each send a
+ * valid and an invalid report.
+ */
+static void
+test_usbmon_descriptor(void)
+{
+    g_autoptr(GByteArray) bytes = g_byte_array_new();
+    struct builder builder = { .data = bytes };
+    const guint8 addresses[] = { GRID_ADDRESS, OTHER_ADDRESS, UNKNOWN_ADDRESS };
+    struct packet packet;
+
+    put_pcap_header(&builder, FALSE, LINKTYPE_USB_LINUX);
+
+    packet = descriptor_packet(
+        TEST_TIME, GRID_ADDRESS, USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_NZXT_GRID_V3);
+    put_pcap_record(&builder, FALSE, LINKTYPE_USB_LINUX, &packet);
+
+    /* Same vendor, different product */
+    packet = descriptor_packet(TEST_TIME, OTHER_ADDRESS, USB_VENDOR_ID_NZXT, 0x170e);
+    put_pcap_record(&builder, FALSE, LINKTYPE_USB_LINUX, &packet);
+
+    for (guint i = 0; i < G_N_ELEMENTS(addresses); i++) {
+        packet = report_packet(TEST_TIME + 1000, addresses[i], NZXT_GRID_STATUS_REPORT_ID, i, 500);
+        put_pcap_record(&builder, FALSE, LINKTYPE_USB_LINUX, &packet);
+
+        packet = report_packet(TEST_TIME + 2000, addresses[i], 2, i, 500);
+        put_pcap_record(&builder, FALSE, LINKTYPE_USB_LINUX, &packet);
+    }
+
+    struct gridctl_usbmon_filter filter = { 0 };
+    struct gridctl_usbmon_stats stats;
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GArray) results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    /* Without a descriptor, a report is taken from any device it decodes for */
+    g_assert_no_error(error);
+    g_assert_cmpuint(stats.n_transfers, ==, 6);
+    g_assert_cmpuint(stats.n_reports, ==, 2);
+    g_assert_cmpuint(stats.n_invalid, ==, 1);
+    g_assert_cmpuint(stats.n_skipped, ==, 3);
+    g_assert_cmpuint(results->len, ==, 2);
+    g_assert_cmpuint(g_array_index(results, struct result, 0).address, ==, GRID_ADDRESS);
+    g_assert_cmpuint(g_array_index(results, struct result, 1).address, ==, UNKNOWN_ADDRESS);
+
+    filter.strict = TRUE;
+    g_array_unref(results);
+    results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    g_assert_no_error(error);
+    g_assert_cmpuint(stats.n_reports, ==, 1);
+    g_assert_cmpuint(stats.n_invalid, ==, 1);
+    g_assert_cmpuint(stats.n_skipped, ==, 4);
+    g_assert_cmpuint(results->len, ==, 1);
+    g_assert_cmpuint(g_array_index(results, struct result, 0).address, ==, GRID_ADDRESS);
+
+    filter = (struct gridctl_usbmon_filter){ .bus = TEST_BUS + 1 };
+    g_array_unref(results);
+    results = import_capture(&builder, bytes->len, &filter, &stats, &error);
+
+    g_assert_no_error(error);
+    g_assert_cmpuint(stats.n_reports, ==, 0);
+    g_assert_cmpuint(stats.n_skipped, ==, 6);
+}
+
+/* A capture cut short while tcpdump was still writing: everything before the cut is reported */
+static void
+test_usbmon_truncated(void)
+{
+    g_autoptr(GArray) packets = make_grid_packets();
+    g_autoptr(GByteArray) pcap = g_byte_array_new();
+    g_autoptr(GByteArray) pcapng = g_byte_array_new();
+    struct builder pcap_builder = { .data = pcap };
+    struct builder pcapng_builder = { .data = pcapng };
+    struct gridctl_usbmon_filter filter = { 0 };
+    struct gridctl_usbmon_stats stats;
+    gsize last_record[2] = { 0 };
+
+    put_pcap_header(&pcap_builder, FALSE, LINKTYPE_USB_LINUX);
+    put_pcapng_section_header(&pcapng_builder);
+    put_pcapng_interface(&pcapng_builder, LINKTYPE_USB_LINUX, 0);
+
+    for (guint i = 0; i < packets->len; i++) {
+        const struct packet *packet = &g_array_index(packets, struct packet, i);
+        g_autoptr(GByteArray) usbmon = g_byte_array_new();
+        struct builder packet_builder = { .data = usbmon };
+
+        last_record[0] = pcap->len;
+        last_record[1] = pcapng->len;
+        put_pcap_record(&pcap_builder, FALSE, LINKTYPE_USB_LINUX, packet);
+        put_usbmon_packet(&packet_builder, LINKTYPE_USB_LINUX, packet);
+        put_pcapng_packet(&pcapng_builder, 0, (guint64)packet->time, usbmon->data, usbmon->len);
+    }
+
+    const struct builder *builders[] = { &pcap_builder, &pcapng_builder };
+
+    for (guint i = 0; i < G_N_ELEMENTS(builders); i++) {
+        const struct builder *builder = builders[i];
+
+        /* Cut inside the last record's header, and one byte short of its end */
+        const gsize sizes[] = { last_record[i] + 4, builder->data->len - 1 };
+
+        for (guint j = 0; j < G_N_ELEMENTS(sizes); j++) {
+            g_autoptr(GError) error = NULL;
+            g_autoptr(GArray) results = import_capture(builder, sizes[j], &filter, &stats, &error);
+
+            g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+            g_assert_nonnull(strstr(error->message, "truncated"));
+            g_assert_cmpuint(stats.n_reports, ==, NZXT_GRID_V3_CHANNEL_COUNT - 1);
+            g_assert_cmpuint(results->len, ==, NZXT_GRID_V3_CHANNEL_COUNT - 1);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GError) error = NULL;
+    int status;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmp_dir = g_dir_make_tmp("gridctl-test-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    for (guint i = 0; i < G_N_ELEMENTS(pcap_variants); i++) {
+        g_test_add_data_func(pcap_variants[i].name, &pcap_variants[i], test_usbmon_pcap);
+    }
+
+    g_test_add_func("/usbmon/pcapng", test_usbmon_pcapng);
+    g_test_add_func("/usbmon/pcapng/no-usbmon", test_usbmon_pcapng_no_usbmon);
+    g_test_add_func("/usbmon/descriptor", test_usbmon_descriptor);
+    g_test_add_func("/usbmon/truncated", test_usbmon_truncated);
+
+    status = g_test_run();
+
+    g_rmdir(tmp_dir);
+    g_free(tmp_dir);
+    return status;
+}
@@ -0,0 +1,482 @@
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "usbmon.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4U
+#define PCAP_MAGIC_NSEC 0xa1b23c4dU
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+
+#define PCAPNG_BLOCK_SHB 0x0a0d0d0aU
+#define PCAPNG_BLOCK_IDB 1U
+#define PCAPNG_BLOCK_EPB 6U
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4dU
+#define PCAPNG_OPTION_END 0
+#define PCAPNG_OPTION_IF_TSRESOL 9
+#define PCAPNG_DEFAULT_TSRESOL 6
+
+#define LINKTYPE_USB_LINUX 189
+#define LINKTYPE_USB_LINUX_MMAPPED 220
+
+/* Drop pages behind the read position every so often, so RSS doesn't grow with the capture */
+#define DROP_BEHIND_SIZE (64 * 1024 * 1024)
+
+/* Packet header written by usbmon, in the capturing host's byte order */
+struct usbmon_header {
+    guint64 id;
+    guint8 type;
+    guint8 transfer_type;
+    guint8 endpoint;
+    guint8 address;
+    guint16 bus;
+    gint8 flag_setup;
+    gint8 flag_data;
+    gint64 ts_sec;
+    gint32 ts_usec;
+    gint32 status;
+    guint32 length;
+    guint32 len_cap;
+    guint8 setup[8];
+} __attribute__((packed));
+
+G_STATIC_ASSERT(sizeof(struct usbmon_header) == 48);
+
+/* LINKTYPE_USB_LINUX_MMAPPED appends interval, start_frame, xfer_flags and ndesc */
+#define USBMON_MMAPPED_HEADER_SIZE 64
+
+#define USBMON_TYPE_COMPLETE 'C'
+#define USBMON_TRANSFER_INTERRUPT 1
+#define USBMON_TRANSFER_CONTROL 2
+#define USBMON_ENDPOINT_IN 0x80
+
+#define USB_DT_DEVICE 1
+#define USB_DT_DEVICE_SIZE 18
+
+enum device_state { DEVICE_UNKNOWN, DEVICE_GRID, DEVICE_OTHER };
+
+struct interface {
+    guint16 link_type;
+    guint8 tsresol;
+};
+
+struct capture {
+    const gchar *path;
+    const guint8 *data;
+    gsize size;
+    gsize dropped;
+    gboolean swapped;
+
+    const struct gridctl_usbmon_filter *filter;
+    GridctlUsbmonReportFunc func;
+    gpointer user_data;
+    struct gridctl_usbmon_stats *stats;
+
+    /* (bus << 8 | address) -> enum device_state, from device descriptors seen so far */
+    GHashTable *devices;
+};
+
+static inline guint16
+get_u16(const struct capture *capture, const guint8 *p)
+{
+    guint16 value;
+    memcpy(&value, p, sizeof(value));
+    return capture->swapped ? GUINT16_SWAP_LE_BE(value) : value;
+}
+
+static inline guint32
+get_u32(const struct capture *capture, const guint8 *p)
+{
+    guint32 value;
+    memcpy(&value, p, sizeof(value));
+    return capture->swapped ? GUINT32_SWAP_LE_BE(value) : value;
+}
+
+static void
+set_corrupt_error(GError **error, const struct capture *capture, gsize offset, const gchar *what)
+{
+    g_set_error(error,
+                G_FILE_ERROR,
+                G_FILE_ERROR_INVAL,
+                "%s: %s at offset %" G_GSIZE_FORMAT,
+                capture->path,
+                what,
+                offset);
+}
+
+static void
+drop_behind(struct capture *capture, gsize offset)
+{
+#ifdef G_OS_UNIX
+    if (offset - capture->dropped < DROP_BEHIND_SIZE) {
+        return;
+    }
+
+    /* The mapping is read-only, so this only forgets pages - they'd be read back if touched */
+    gsize page_size = (gsize)sysconf(_SC_PAGESIZE);
+    gsize end = offset / page_size * page_size;
+
+    madvise((void *)(capture->data + capture->dropped), end - capture->dropped, MADV_DONTNEED);
+    capture->dropped = end;
+#endif
+}
+
+static gint64
+timestamp_to_usec(guint64 timestamp, guint8 tsresol)
+{
+    /* The high bit selects a power of 2 instead of a power of 10 */
+    if (tsresol & 0x80) {
+        return (gint64)((gdouble)timestamp / (gdouble)(G_GUINT64_CONSTANT(1) << (tsresol & 0x3f))
+                        * G_USEC_PER_SEC);
+    }
+
+    for (; tsresol > 6; tsresol--) {
+        timestamp /= 10;
+    }
+    for (; tsresol < 6; tsresol++) {
+        timestamp *= 10;
+    }
+
+    return (gint64)timestamp;
+}
+
+static inline guint
+device_key(guint16 bus, guint8 address)
+{
+    return (guint)bus << 8 | address;
+}
+
+static void
+handle_device_descriptor(struct capture *capture,
+                         guint16 bus,
+                         guint8 address,
+                         const guint8 *payload,
+                         gsize payload_size)
+{
+    /* Address 0 is only used during enumeration, before SET_ADDRESS */
+    if (address == 0 || payload_size < 12 || payload[0] != USB_DT_DEVICE_SIZE
+        || payload[1] != USB_DT_DEVICE)
+    {
+        return;
+    }
+
+    /* Descriptors are little-endian, unlike the usbmon header */
+    guint16 vendor_id = payload[8] | (guint16)(payload[9] << 8);
+    guint16 product_id = payload[10] | (guint16)(payload[11] << 8);
+    gboolean is_grid = vendor_id == USB_VENDOR_ID_NZXT && product_id == USB_PRODUCT_ID_NZXT_GRID_V3;
+
+    g_hash_table_insert(capture->devices,
+                        GUINT_TO_POINTER(device_key(bus, address)),
+                        GUINT_TO_POINTER(is_grid ? DEVICE_GRID : DEVICE_OTHER));
+}
+
+static gboolean
+handle_packet(struct capture *capture,
+              guint16 link_type,
+              gint64 time,
+              const guint8 *data,
+              gsize size)
+{
+    gsize header_size = link_type == LINKTYPE_USB_LINUX_MMAPPED ? USBMON_MMAPPED_HEADER_SIZE
+                                                               : sizeof(struct usbmon_header);
+
+    capture->stats->n_packets++;
+
+    if (size < header_size) {
+        return TRUE;
+    }
+
+    const struct usbmon_header *header = (const void *)data;
+    guint16 bus = get_u16(capture, (const guint8 *)&header->bus);
+    guint32 captured_size = get_u32(capture, (const guint8 *)&header->len_cap);
+    const guint8 *payload = data + header_size;
+    gsize payload_size = MIN(captured_size, size - header_size);
+
+    /* flag_data is 0 when data is present, otherwise a character telling why it isn't */
+    if (header->type != USBMON_TYPE_COMPLETE || header->flag_data != 0 || payload_size == 0) {
+        return TRUE;
+    }
+
+    if (header->transfer_type == USBMON_TRANSFER_CONTROL) {
+        handle_device_descriptor(capture, bus, header->address, payload, payload_size);
+        return TRUE;
+    }
+
+    if (header->transfer_type != USBMON_TRANSFER_INTERRUPT
+        || !(header->endpoint & USBMON_ENDPOINT_IN))
+    {
+        return TRUE;
+    }
+
+    capture->stats->n_transfers++;
+
+    const struct gridctl_usbmon_filter *filter = capture->filter;
+    enum device_state state = GPOINTER_TO_UINT(
+        g_hash_table_lookup(capture->devices, GUINT_TO_POINTER(device_key(bus, header->address))));
+    gboolean valid = nzxt_grid_status_report_is_valid(payload, payload_size);
+
+    if ((filter->bus && filter->bus != bus)
+        || (filter->address && filter->address != header->address) || state == DEVICE_OTHER
+        || (state == DEVICE_UNKNOWN && (filter->strict || !valid)))
+    {
+        capture->stats->n_skipped++;
+        return TRUE;
+    }
+
+    if (!valid) {
+        capture->stats->n_invalid++;
+        return TRUE;
+    }
+
+    struct gridctl_usbmon_report report = {
+        .time = time,
+        .bus = bus,
+        .address = header->address,
+        .report = (const void *)payload,
+    };
+
+    capture->stats->n_reports++;
+    return capture->func(&report, capture->user_data);
+}
+
+static gboolean
+read_pcap(struct capture *capture, GError **error)
+{
+    guint32 magic = get_u32(capture, capture->data);
+    gboolean nsec = magic == PCAP_MAGIC_NSEC || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NSEC);
+
+    capture->swapped = magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_USEC)
+                       || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NSEC);
+
+    if (capture->size < PCAP_HEADER_SIZE) {
+        set_corrupt_error(error, capture, 0, "truncated pcap header");
+        return FALSE;
+    }
+
+    /* The upper bits may carry FCS information */
+    guint16 link_type = get_u32(capture, capture->data + 20) & 0xffff;
+    if (link_type != LINKTYPE_USB_LINUX && link_type != LINKTYPE_USB_LINUX_MMAPPED) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_INVAL,
+                    "%s: not a usbmon capture (link type %u)",
+                    capture->path,
+                    link_type);
+        return FALSE;
+    }
+
+    gsize offset = PCAP_HEADER_SIZE;
+
+    while (offset < capture->size) {
+        const guint8 *record = capture->data + offset;
+
+        if (capture->size - offset < PCAP_RECORD_HEADER_SIZE) {
+            set_corrupt_error(error, capture, offset, "truncated record header");
+            return FALSE;
+        }
+
+        guint32 captured_size = get_u32(capture, record + 8);
+        if (captured_size > capture->size - offset - PCAP_RECORD_HEADER_SIZE) {
+            set_corrupt_error(error, capture, offset, "truncated record");
+            return FALSE;
+        }
+
+        guint32 fraction = get_u32(capture, record + 4);
+        gint64 time = (gint64)get_u32(capture, record) * G_USEC_PER_SEC
+                      + (nsec ? fraction / 1000 : fraction);
+
+        offset += PCAP_RECORD_HEADER_SIZE + captured_size;
+        capture->stats->n_bytes = offset;
+
+        if (!handle_packet(
+                capture, link_type, time, record + PCAP_RECORD_HEADER_SIZE, captured_size))
+        {
+            return TRUE;
+        }
+
+        drop_behind(capture, offset);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+read_pcapng_interface(struct capture *capture,
+                      const guint8 *block,
+                      guint32 block_size,
+                      GArray *interfaces)
+{
+    struct interface interface = {
+        .link_type = get_u16(capture, block + 8),
+        .tsresol = PCAPNG_DEFAULT_TSRESOL,
+    };
+
+    /* Options start after type, length, link type, reserved and snaplen */
+    for (guint32 offset = 16; offset + 4 <= block_size - 4;) {
+        guint16 code = get_u16(capture, block + offset);
+        guint16 length = get_u16(capture, block + offset + 2);
+
+        if (code == PCAPNG_OPTION_END || offset + 4 + length > block_size - 4) {
+            break;
+        }
+
+        if (code == PCAPNG_OPTION_IF_TSRESOL && length == 1) {
+            interface.tsresol = block[offset + 4];
+        }
+
+        offset += 4 + ((length + 3U) & ~3U);
+    }
+
+    g_array_append_val(interfaces, interface);
+    return interface.link_type == LINKTYPE_USB_LINUX
+           || interface.link_type == LINKTYPE_USB_LINUX_MMAPPED;
+}
+
+static gboolean
+read_pcapng(struct capture *capture, GError **error)
+{
+    g_autoptr(GArray) interfaces = g_array_new(FALSE, FALSE, sizeof(struct interface));
+    gboolean has_usbmon = FALSE;
+    gsize offset = 0;
+
+    while (offset < capture->size) {
+        const guint8 *block = capture->data + offset;
+
+        if (capture->size - offset < 12) {
+            set_corrupt_error(error, capture, offset, "truncated block header");
+            return FALSE;
+        }
+
+        guint32 block_type = get_u32(capture, block);
+
+        /* Every section starts with its own byte order, and its own set of interfaces */
+        if (block_type == PCAPNG_BLOCK_SHB) {
+            guint32 byte_order_magic;
+            memcpy(&byte_order_magic, block + 8, sizeof(byte_order_magic));
+
+            if (byte_order_magic == PCAPNG_BYTE_ORDER_MAGIC) {
+                capture->swapped = FALSE;
+            } else if (byte_order_magic == GUINT32_SWAP_LE_BE(PCAPNG_BYTE_ORDER_MAGIC)) {
+                capture->swapped = TRUE;
+            } else {
+                set_corrupt_error(error, capture, offset, "bad section header byte order");
+                return FALSE;
+            }
+
+            g_array_set_size(interfaces, 0);
+        }
+
+        guint32 block_size = get_u32(capture, block + 4);
+        if (block_size < 12 || block_size % 4 != 0 || block_size > capture->size - offset) {
+            set_corrupt_error(error, capture, offset, "truncated block");
+            return FALSE;
+        }
+
+        if (block_type == PCAPNG_BLOCK_IDB && block_size >= 20) {
+            has_usbmon |= read_pcapng_interface(capture, block, block_size, interfaces);
+        } else if (block_type == PCAPNG_BLOCK_EPB && block_size >= 32) {
+            guint32 interface_id = get_u32(capture, block + 8);
+            guint32 captured_size = get_u32(capture, block + 20);
+
+            if (interface_id >= interfaces->len || captured_size > block_size - 32) {
+                set_corrupt_error(error, capture, offset, "bad enhanced packet block");
+                return FALSE;
+            }
+
+            const struct interface *interface
+                = &g_array_index(interfaces, struct interface, interface_id);
+            guint64 timestamp = (guint64)get_u32(capture, block + 12) << 32
+                                | get_u32(capture, block + 16);
+
+            if ((interface->link_type == LINKTYPE_USB_LINUX
+                 || interface->link_type == LINKTYPE_USB_LINUX_MMAPPED)
+                && !handle_packet(capture,
+                                  interface->link_type,
+                                  timestamp_to_usec(timestamp, interface->tsresol),
+                                  block + 28,
+                                  captured_size))
+            {
+                capture->stats->n_bytes = offset + block_size;
+                return TRUE;
+            }
+        }
+
+        offset += block_size;
+        capture->stats->n_bytes = offset;
+        drop_behind(capture, offset);
+    }
+
+    if (!has_usbmon) {
+        g_set_error(
+            error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: no usbmon interfaces", capture->path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Calls func for every status report in the capture, in capture order. Returns TRUE when the
+ * whole capture was read or func returned FALSE to stop early. On a malformed capture, returns
+ * FALSE with error set, after reporting everything up to the bad record.
+ */
+gboolean
+gridctl_usbmon_import(const gchar *path,
+                      const struct gridctl_usbmon_filter *filter,
+                      GridctlUsbmonReportFunc func,
+                      gpointer user_data,
+                      struct gridctl_usbmon_stats *stats,
+                      GError **error)
+{
+    g_autoptr(GMappedFile) file = g_mapped_file_new(path, FALSE, error);
+    if (!file) {
+        return FALSE;
+    }
+
+    struct gridctl_usbmon_stats import_stats = { 0 };
+    struct capture capture = {
+        .path = path,
+        .data = (const guint8 *)g_mapped_file_get_contents(file),
+        .size = g_mapped_file_get_length(file),
+        .filter = filter,
+        .func = func,
+        .user_data = user_data,
+        .stats = stats ? stats : &import_stats,
+        .devices = g_hash_table_new(g_direct_hash, g_direct_equal),
+    };
+    gboolean ok;
+
+    memset(capture.stats, 0, sizeof(*capture.stats));
+
+#ifdef G_OS_UNIX
+    if (capture.size) {
+        madvise((void *)capture.data, capture.size, MADV_SEQUENTIAL);
+    }
+#endif
+
+    guint32 magic = 0;
+    if (capture.size >= sizeof(magic)) {
+        memcpy(&magic, capture.data, sizeof(magic));
+    }
+
+    if (magic == PCAPNG_BLOCK_SHB) {
+        ok = read_pcapng(&capture, error);
+    } else if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC
+               || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_USEC)
+               || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NSEC))
+    {
+        ok = read_pcap(&capture, error);
+    } else {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: not a pcap or pcapng file", path);
+        ok = FALSE;
+    }
+
+    g_hash_table_unref(capture.devices);
+    return ok;
+}
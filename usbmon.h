@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glib.h>
+
+#include "nzxtgridproto.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Extracts Grid status reports from Linux usbmon captures (tcpdump -i usbmonN, Wireshark), in
+ * pcap or pcapng format. The capture is memory-mapped and read once front to back, so files larger
+ * than RAM are fine.
+ *
+ * usbmon packets don't carry vendor/product IDs. A device is known to be a Grid once its device
+ * descriptor shows up in the capture, i.e. if the capture started before it was plugged in.
+ * Interrupt IN data from devices that were never identified is accepted if it decodes as a status
+ * report, unless the filter is strict.
+ */
+
+struct gridctl_usbmon_filter {
+    guint16 bus; /* 0 - any */
+    guint8 address; /* 0 - any */
+    gboolean strict; /* skip devices whose descriptor isn't in the capture */
+};
+
+struct gridctl_usbmon_report {
+    gint64 time; /* capture time, microseconds since the Unix epoch */
+    guint16 bus;
+    guint8 address;
+    const struct nzxt_grid_status_report *report; /* points into the mapped capture */
+};
+
+struct gridctl_usbmon_stats {
+    guint64 n_bytes;
+    guint64 n_packets; /* usbmon packets, any device */
+    guint64 n_transfers; /* interrupt IN completions with data, any device */
+    guint64 n_reports;
+    guint64 n_invalid; /* from a Grid, but not a status report */
+    guint64 n_skipped; /* from other or filtered out devices */
+};
+
+typedef gboolean (*GridctlUsbmonReportFunc)(const struct gridctl_usbmon_report *report,
+                                            gpointer user_data);
+
+gboolean
+gridctl_usbmon_import(const gchar *path,
+                      const struct gridctl_usbmon_filter *filter,
+                      GridctlUsbmonReportFunc func,
+                      gpointer user_data,
+                      struct gridctl_usbmon_stats *stats,
+                      GError **error);
+
+G_END_DECLS
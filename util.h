@@ -0,0 +1,25 @@
+#pragma once
+
+#include <errno.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* libgridctl internals, not installed */
+
+/* Sets a G_FILE_ERROR for a failed func(name) call from the current errno */
+static inline void
+gridctl_set_error_from_errno(GError **error, const gchar *func, const gchar *name)
+{
+    int errsv = errno;
+    g_set_error(error,
+                G_FILE_ERROR,
+                g_file_error_from_errno(errsv),
+                "%s(%s): %s",
+                func,
+                name,
+                g_strerror(errsv));
+}
+
+G_END_DECLS
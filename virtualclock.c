@@ -0,0 +1,196 @@
+#include "virtualclock.h"
+
+/*
+ * Time only moves when gridctl_virtual_clock_advance() is called. Timeouts that fall due are
+ * dispatched in deadline order (ties in creation order), with the clock set to each deadline
+ * while its callback runs, so a day of timer activity replays in as long as the callbacks take.
+ */
+
+struct virtual_timeout {
+    guint id;
+    gint64 deadline;
+    gint64 interval;
+    GSourceFunc func;
+    gpointer data;
+};
+
+struct _GridctlVirtualClock {
+    GridctlClock parent_instance;
+
+    gint64 now;
+    guint next_id;
+    GList *timeouts; /* sorted by deadline, then id */
+
+    struct virtual_timeout *dispatching;
+    gboolean dispatching_removed;
+};
+
+G_DEFINE_TYPE(GridctlVirtualClock, gridctl_virtual_clock, GRIDCTL_TYPE_CLOCK)
+
+static gint
+compare_timeouts(gconstpointer a, gconstpointer b)
+{
+    const struct virtual_timeout *timeout_a = a;
+    const struct virtual_timeout *timeout_b = b;
+
+    if (timeout_a->deadline != timeout_b->deadline) {
+        return timeout_a->deadline < timeout_b->deadline ? -1 : 1;
+    }
+
+    return timeout_a->id < timeout_b->id ? -1 : (timeout_a->id > timeout_b->id);
+}
+
+static gint64
+get_time(GridctlClock *clock)
+{
+    return GRIDCTL_VIRTUAL_CLOCK(clock)->now;
+}
+
+static guint
+add_timeout(GridctlClock *clock, guint interval_ms, GSourceFunc func, gpointer data)
+{
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+    struct virtual_timeout *timeout = g_new0(struct virtual_timeout, 1);
+
+    /* A zero interval would dispatch forever without time moving */
+    timeout->interval = MAX((gint64)interval_ms * 1000, 1);
+    timeout->id = ++virtual_clock->next_id;
+    timeout->deadline = virtual_clock->now + timeout->interval;
+    timeout->func = func;
+    timeout->data = data;
+
+    virtual_clock->timeouts
+        = g_list_insert_sorted(virtual_clock->timeouts, timeout, compare_timeouts);
+    return timeout->id;
+}
+
+static guint
+add_timeout_seconds(GridctlClock *clock, guint interval_s, GSourceFunc func, gpointer data)
+{
+    return add_timeout(clock, interval_s * 1000, func, data);
+}
+
+static void
+remove_timeout(GridctlClock *clock, guint id)
+{
+    GridctlVirtualClock *virtual_clock = GRIDCTL_VIRTUAL_CLOCK(clock);
+
+    if (virtual_clock->dispatching && virtual_clock->dispatching->id == id) {
+        virtual_clock->dispatching_removed = TRUE;
+        return;
+    }
+
+    for (GList *l = virtual_clock->timeouts; l != NULL; l = l->next) {
+        struct virtual_timeout *timeout = l->data;
+
+        if (timeout->id == id) {
+            virtual_clock->timeouts = g_list_delete_link(virtual_clock->timeouts, l);
+            g_free(timeout);
+            return;
+        }
+    }
+
+    g_critical("Virtual clock timeout %u not found", id);
+}
+
+static void
+dispatch_first(GridctlVirtualClock *clock)
+{
+    struct virtual_timeout *timeout = clock->timeouts->data;
+
+    clock->timeouts = g_list_delete_link(clock->timeouts, clock->timeouts);
+    clock->now = timeout->deadline;
+    clock->dispatching = timeout;
+    clock->dispatching_removed = FALSE;
+
+    gboolean again = timeout->func(timeout->data);
+
+    clock->dispatching = NULL;
+
+    if (again && !clock->dispatching_removed) {
+        timeout->deadline += timeout->interval;
+        clock->timeouts = g_list_insert_sorted(clock->timeouts, timeout, compare_timeouts);
+    } else {
+        g_free(timeout);
+    }
+}
+
+static void
+finalize(GObject *object)
+{
+    GridctlVirtualClock *clock = GRIDCTL_VIRTUAL_CLOCK(object);
+
+    g_list_free_full(clock->timeouts, g_free);
+
+    G_OBJECT_CLASS(gridctl_virtual_clock_parent_class)->finalize(object);
+}
+
+static void
+gridctl_virtual_clock_class_init(GridctlVirtualClockClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+    gobject_class->finalize = finalize;
+
+    GridctlClockClass *clock_class = GRIDCTL_CLOCK_CLASS(class);
+    clock_class->get_time = get_time;
+    clock_class->add_timeout = add_timeout;
+    clock_class->add_timeout_seconds = add_timeout_seconds;
+    clock_class->remove_timeout = remove_timeout;
+}
+
+static void
+gridctl_virtual_clock_init(GridctlVirtualClock *obj)
+{
+}
+
+GridctlClock *
+gridctl_virtual_clock_new(gint64 start_time)
+{
+    GridctlVirtualClock *clock = g_object_new(GRIDCTL_TYPE_VIRTUAL_CLOCK, NULL);
+
+    clock->now = start_time;
+    return GRIDCTL_CLOCK(clock);
+}
+
+/* Move time forward by delta microseconds, dispatching every timeout that falls due */
+void
+gridctl_virtual_clock_advance(GridctlVirtualClock *clock, gint64 delta)
+{
+    g_return_if_fail(GRIDCTL_IS_VIRTUAL_CLOCK(clock));
+    g_return_if_fail(delta >= 0);
+
+    gint64 target = clock->now + delta;
+
+    while (clock->timeouts) {
+        const struct virtual_timeout *first = clock->timeouts->data;
+
+        if (first->deadline > target) {
+            break;
+        }
+
+        dispatch_first(clock);
+    }
+
+    clock->now = target;
+}
+
+/* Jump straight to the next deadline and dispatch it. Returns FALSE if nothing is scheduled */
+gboolean
+gridctl_virtual_clock_advance_to_next(GridctlVirtualClock *clock)
+{
+    g_return_val_if_fail(GRIDCTL_IS_VIRTUAL_CLOCK(clock), FALSE);
+
+    if (!clock->timeouts) {
+        return FALSE;
+    }
+
+    dispatch_first(clock);
+    return TRUE;
+}
+
+guint
+gridctl_virtual_clock_get_n_timeouts(GridctlVirtualClock *clock)
+{
+    g_return_val_if_fail(GRIDCTL_IS_VIRTUAL_CLOCK(clock), 0);
+    return g_list_length(clock->timeouts) + (clock->dispatching != NULL);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "clock.h"
+
+G_BEGIN_DECLS
+
+#define GRIDCTL_TYPE_VIRTUAL_CLOCK (gridctl_virtual_clock_get_type())
+G_DECLARE_FINAL_TYPE(GridctlVirtualClock,
+                     gridctl_virtual_clock,
+                     GRIDCTL,
+                     VIRTUAL_CLOCK,
+                     GridctlClock)
+
+GridctlClock *
+gridctl_virtual_clock_new(gint64 start_time);
+
+void
+gridctl_virtual_clock_advance(GridctlVirtualClock *clock, gint64 delta);
+
+gboolean
+gridctl_virtual_clock_advance_to_next(GridctlVirtualClock *clock);
+
+guint
+gridctl_virtual_clock_get_n_timeouts(GridctlVirtualClock *clock);
+
+G_END_DECLS